@@ -0,0 +1,121 @@
+#include "asset_manager.h"
+
+#include <iostream>
+
+#include "mapped_file.h"
+
+std::ostream& operator<<(std::ostream& out, const AssetStats& s) {
+	out << (s.bytes_read >> 10) << " KB read from disk, " << (s.bytes_resident >> 10) << " KB resident ("
+		<< (s.texture_bytes >> 10) << " KB textures), "
+		<< s.loads << " loads, " << s.hits << " hits, " << s.evictions << " evictions";
+	return out;
+}
+
+AssetManager& AssetManager::global() {
+	static AssetManager assets;
+	return assets;
+}
+
+std::shared_ptr<const Model> AssetManager::model(const std::string& filename) {
+	const std::string key = "model:" + filename;
+	if (std::shared_ptr<const void> hit = find(key)) return std::static_pointer_cast<const Model>(hit);
+	//ʱ,texture()ص
+	std::shared_ptr<const Model> m = std::make_shared<Model>(filename, true,
+		[this](const std::string& texfile) { return texture(texfile); });
+	if (!m->nfaces()) return m;
+	return std::static_pointer_cast<const Model>(insert(key, m, m->memory_bytes(), m->disk_bytes(), false));
+}
+
+Texture AssetManager::texture(const std::string& filename) {
+	const std::string key = "texture:" + filename;
+	if (std::shared_ptr<const void> hit = find(key)) return Texture(std::static_pointer_cast<const MipTexture>(hit));
+	std::shared_ptr<TGAImage> img = std::make_shared<TGAImage>();
+	const bool ok = img->read_tga_file(filename);
+	std::cerr << "texture file " << filename << " loading " << (ok ? "ok" : "failed") << std::endl;
+	if (!ok) return Texture();
+	Texture tex(std::move(img));
+	return Texture(std::static_pointer_cast<const MipTexture>(insert(key, tex.shared(), tex.bytes(), file_size(filename), true)));
+}
+
+std::shared_ptr<const void> AssetManager::find(const std::string& key) {
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = entries.find(key);
+	if (it == entries.end()) return nullptr;
+	lru.splice(lru.begin(), lru, it->second.lru);
+	frame.hits++;
+	return it->second.asset;
+}
+
+std::shared_ptr<const void> AssetManager::insert(const std::string& key, std::shared_ptr<const void> asset, size_t bytes, size_t disk_bytes, bool texture) {
+	std::lock_guard<std::mutex> lock(mtx);
+	frame.bytes_read += disk_bytes;
+	frame.loads++;
+	//߳ȼͬһļ
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		lru.splice(lru.begin(), lru, it->second.lru);
+		return it->second.asset;
+	}
+	lru.push_front(key);
+	entries.emplace(key, Entry{ asset, bytes, texture, lru.begin() });
+	resident_bytes += bytes;
+	if (texture) texture_bytes += bytes;
+	trim();
+	return asset;
+}
+
+void AssetManager::trim() {
+	//δõĿʼ̭,ֻлռԴͷ;
+	//ģͷźűΪռ,ظɨֱûнչ
+	bool progress = true;
+	while (resident_bytes > budget_bytes && progress) {
+		progress = false;
+		for (auto it = lru.end(); it != lru.begin() && resident_bytes > budget_bytes;) {
+			--it;
+			auto e = entries.find(*it);
+			if (e->second.asset.use_count() > 1) continue;
+			resident_bytes -= e->second.bytes;
+			if (e->second.texture) texture_bytes -= e->second.bytes;
+			entries.erase(e);
+			it = lru.erase(it);
+			frame.evictions++;
+			progress = true;
+		}
+	}
+}
+
+AssetStats AssetManager::begin_frame() {
+	std::lock_guard<std::mutex> lock(mtx);
+	AssetStats s = frame;
+	s.bytes_resident = resident_bytes;
+	s.texture_bytes = texture_bytes;
+	frame = AssetStats();
+	return s;
+}
+
+AssetStats AssetManager::frame_stats() const {
+	std::lock_guard<std::mutex> lock(mtx);
+	AssetStats s = frame;
+	s.bytes_resident = resident_bytes;
+	s.texture_bytes = texture_bytes;
+	return s;
+}
+
+void AssetManager::set_budget(size_t bytes) {
+	std::lock_guard<std::mutex> lock(mtx);
+	budget_bytes = bytes;
+	trim();
+}
+
+size_t AssetManager::resident() const {
+	std::lock_guard<std::mutex> lock(mtx);
+	return resident_bytes;
+}
+
+void AssetManager::clear() {
+	std::lock_guard<std::mutex> lock(mtx);
+	frame.evictions += (int)entries.size();
+	entries.clear();
+	lru.clear();
+	resident_bytes = texture_bytes = 0;
+}
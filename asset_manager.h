@@ -0,0 +1,72 @@
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+#include "model.h"
+#include "texture.h"
+
+//һ֡ڵԴͳ
+struct AssetStats {
+	size_t bytes_read = 0;     //Ӵ̶ȡֽ
+	size_t bytes_resident = 0; //Դռõڴ
+	size_t texture_bytes = 0;  //(ԭͼmip),ÿֻһ
+	int loads = 0, hits = 0, evictions = 0;
+};
+
+std::ostream& operator<<(std::ostream& out, const AssetStats& s);
+
+//ģĹ,ͬʱע:ͬһļֻһ,Ⱦpassshared_ptr/Texture
+//פڴ泬ԤʱLRṶ,ԱõԴ̭
+class AssetManager {
+public:
+	static constexpr size_t DEFAULT_BUDGET = size_t(1) << 30;
+
+	explicit AssetManager(size_t budget_bytes = DEFAULT_BUDGET) : budget_bytes(budget_bytes) {}
+	AssetManager(const AssetManager&) = delete;
+	AssetManager& operator=(const AssetManager&) = delete;
+
+	//ģ͵Ҳɱ,ģͿɹ
+	std::shared_ptr<const Model> model(const std::string& filename);
+	//ȡʧܷؿվ,ʧܲ
+	Texture texture(const std::string& filename);
+
+	//һ֡,ͳƲ
+	AssetStats begin_frame();
+	AssetStats frame_stats() const;
+
+	size_t budget() const { return budget_bytes; }
+	void set_budget(size_t bytes);
+	size_t resident() const;
+	void clear();
+
+	static AssetManager& global();
+
+private:
+	struct Entry {
+		std::shared_ptr<const void> asset;
+		size_t bytes;
+		bool texture;
+		std::list<std::string>::iterator lru;
+	};
+
+	std::shared_ptr<const void> find(const std::string& key);
+	std::shared_ptr<const void> insert(const std::string& key, std::shared_ptr<const void> asset, size_t bytes, size_t disk_bytes, bool texture);
+	void trim();
+
+	size_t budget_bytes;
+	size_t resident_bytes = 0;
+	size_t texture_bytes = 0;
+	std::unordered_map<std::string, Entry> entries;
+	std::list<std::string> lru;          //ͷʹ
+	AssetStats frame;
+	mutable std::mutex mtx;
+};
+
+#endif // !ASSET_MANAGER_H
@@ -0,0 +1,230 @@
+#include "bvh.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+//,һڵԲһ(4)εĴ,SAHΪʱҶŵ
+constexpr int SAH_BINS = 16;
+constexpr float TRAVERSAL_COST = 1.f;
+constexpr int MAX_LEAF = 16;
+//ֱҶ,õջ˿Ƕ
+constexpr int MAX_DEPTH = 60;
+
+struct BVH::BuildTriangle {
+	vec3 lo, hi, c;
+	int index;
+};
+
+struct Bounds {
+	vec3 lo = vec3(1, 1, 1) * std::numeric_limits<float>::max();
+	vec3 hi = vec3(1, 1, 1) * -std::numeric_limits<float>::max();
+
+	void grow(const vec3& p) {
+		for (int a = 0; a < 3; a++) lo[a] = std::min(lo[a], p[a]), hi[a] = std::max(hi[a], p[a]);
+	}
+	void grow(const Bounds& b) {
+		if (b.lo.x <= b.hi.x) grow(b.lo), grow(b.hi);
+	}
+	float area() const {
+		if (lo.x > hi.x) return 0;
+		const vec3 d = hi - lo;
+		return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+};
+
+static int quad_count(int ntriangles) {
+	return (ntriangles + 3) / 4;
+}
+
+std::ostream& operator<<(std::ostream& out, const BVHStats& s) {
+	out << s.triangles << " triangles, " << s.nodes << " nodes (" << s.leaves << " leaves, depth " << s.depth << "), built in " << s.build_ms << " ms";
+	return out;
+}
+
+void BVH::add(const Model& model, const mat<4, 4>& transform) {
+	for (int iface = 0; iface < model.nfaces(); iface++)
+		for (int ivert = 0; ivert < 3; ivert++)
+			verts.push_back(proj<3>(transform * embed<4>(model.vert(iface, ivert), 1.f)));
+}
+
+void BVH::build() {
+	const auto t0 = std::chrono::steady_clock::now();
+	std::vector<BuildTriangle> tris(verts.size() / 3);
+	for (size_t i = 0; i < tris.size(); i++) {
+		Bounds b;
+		for (int k = 0; k < 3; k++) b.grow(verts[3 * i + k]);
+		tris[i] = { b.lo, b.hi, (b.lo + b.hi) * .5f, (int)i };
+	}
+	nodes.clear(), quads.clear();
+	st = BVHStats();
+	st.triangles = (int)tris.size();
+	if (!tris.empty()) build_node(tris, 0, (int)tris.size(), 0);
+	st.nodes = (int)nodes.size();
+	verts.clear();
+	verts.shrink_to_fit();
+	st.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int BVH::build_node(std::vector<BuildTriangle>& tris, int begin, int end, int depth) {
+	st.depth = std::max(st.depth, depth);
+	const int idx = (int)nodes.size();
+	nodes.push_back({});
+	Bounds bounds, centroids;
+	for (int i = begin; i < end; i++) {
+		bounds.grow(tris[i].lo), bounds.grow(tris[i].hi);
+		centroids.grow(tris[i].c);
+	}
+	for (int a = 0; a < 3; a++) nodes[idx].lo[a] = bounds.lo[a], nodes[idx].hi[a] = bounds.hi[a];
+
+	//SAH_BINS,ҴСĻ
+	const int n = end - begin;
+	const float leaf_cost = (float)quad_count(n);
+	float best_cost = std::numeric_limits<float>::max();
+	int best_axis = -1, best_bin = 0;
+	for (int a = 0; n > 4 && a < 3; a++) {
+		const float extent = centroids.hi[a] - centroids.lo[a];
+		if (extent <= 0) continue;
+		Bounds bins[SAH_BINS];
+		int counts[SAH_BINS] = {};
+		for (int i = begin; i < end; i++) {
+			const int b = std::min(SAH_BINS - 1, int((tris[i].c[a] - centroids.lo[a]) / extent * SAH_BINS));
+			bins[b].grow(tris[i].lo), bins[b].grow(tris[i].hi);
+			counts[b]++;
+		}
+		//right_area[s]right_count[s][s,SAH_BINS)ĺϼ
+		float right_area[SAH_BINS];
+		int right_count[SAH_BINS];
+		Bounds right;
+		for (int s = SAH_BINS - 1, count = 0; s > 0; s--) {
+			right.grow(bins[s]);
+			count += counts[s];
+			right_area[s] = right.area(), right_count[s] = count;
+		}
+		Bounds left;
+		for (int s = 1, count = 0; s < SAH_BINS; s++) {
+			left.grow(bins[s - 1]);
+			count += counts[s - 1];
+			if (!count || !right_count[s]) continue;
+			const float cost = TRAVERSAL_COST + (left.area() * quad_count(count) + right_area[s] * quad_count(right_count[s])) / bounds.area();
+			if (cost < best_cost) best_cost = cost, best_axis = a, best_bin = s;
+		}
+	}
+
+	const bool small = n <= MAX_LEAF && (best_axis < 0 || best_cost >= leaf_cost);
+	if (n <= 4 || small || depth >= MAX_DEPTH) {
+		nodes[idx].first = (int)quads.size();
+		nodes[idx].count = quad_count(n);
+		for (int i = begin; i < end; i += 4) {
+			TriangleQuad q = {};
+			for (int k = 0; k < 4 && i + k < end; k++) {
+				const vec3* v = &verts[3 * tris[i + k].index];
+				for (int a = 0; a < 3; a++) {
+					q.v0[a][k] = v[0][a];
+					q.e1[a][k] = v[1][a] - v[0][a];
+					q.e2[a][k] = v[2][a] - v[0][a];
+				}
+			}
+			quads.push_back(q);
+		}
+		st.leaves++;
+		return idx;
+	}
+
+	int mid;
+	if (best_axis < 0) {
+		//ȫغ,ֻܰ±԰
+		mid = begin + n / 2;
+	}
+	else {
+		const float lo = centroids.lo[best_axis], extent = centroids.hi[best_axis] - lo;
+		mid = int(std::partition(tris.begin() + begin, tris.begin() + end, [&](const BuildTriangle& t) {
+			return std::min(SAH_BINS - 1, int((t.c[best_axis] - lo) / extent * SAH_BINS)) < best_bin;
+		}) - tris.begin());
+	}
+	build_node(tris, begin, mid, depth + 1);
+	const int right = build_node(tris, mid, end, depth + 1);
+	nodes[idx].first = right;
+	nodes[idx].count = 0;
+	return idx;
+}
+
+float BVH::diagonal() const {
+	if (nodes.empty()) return 0;
+	const Node& root = nodes[0];
+	return vec3(root.hi[0] - root.lo[0], root.hi[1] - root.lo[1], root.hi[2] - root.lo[2]).norm();
+}
+
+//Moller-Trumbore,4һ
+bool BVH::occluded(const TriangleQuad& q, const Ray& ray) const {
+#ifdef USE_X86_SIMD
+	const __m128 dx = _mm_set1_ps(ray.dir.x), dy = _mm_set1_ps(ray.dir.y), dz = _mm_set1_ps(ray.dir.z);
+	const __m128 e1x = _mm_load_ps(q.e1[0]), e1y = _mm_load_ps(q.e1[1]), e1z = _mm_load_ps(q.e1[2]);
+	const __m128 e2x = _mm_load_ps(q.e2[0]), e2y = _mm_load_ps(q.e2[1]), e2z = _mm_load_ps(q.e2[2]);
+	const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	const __m128 inv = _mm_div_ps(_mm_set1_ps(1.f), det);
+	const __m128 tx = _mm_sub_ps(_mm_set1_ps(ray.origin.x), _mm_load_ps(q.v0[0]));
+	const __m128 ty = _mm_sub_ps(_mm_set1_ps(ray.origin.y), _mm_load_ps(q.v0[1]));
+	const __m128 tz = _mm_sub_ps(_mm_set1_ps(ray.origin.z), _mm_load_ps(q.v0[2]));
+	const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inv);
+	const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+	//detΪ0(õ˻)ʱu,v,tinfnan,ıȽ϶
+	const __m128 zero = _mm_setzero_ps();
+	__m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+	hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+	hit = _mm_and_ps(hit, _mm_cmpgt_ps(t, _mm_set1_ps(ray.tmin)));
+	hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(ray.tmax)));
+	hit = _mm_and_ps(hit, _mm_cmpneq_ps(det, zero));
+	return _mm_movemask_ps(hit) != 0;
+#else
+	for (int k = 0; k < 4; k++) {
+		const vec3 e1(q.e1[0][k], q.e1[1][k], q.e1[2][k]), e2(q.e2[0][k], q.e2[1][k], q.e2[2][k]);
+		const vec3 p = cross(ray.dir, e2);
+		const float det = e1 * p;
+		if (det == 0) continue;
+		const float inv = 1.f / det;
+		const vec3 tvec = ray.origin - vec3(q.v0[0][k], q.v0[1][k], q.v0[2][k]);
+		const float u = (tvec * p) * inv;
+		const vec3 qvec = cross(tvec, e1);
+		const float v = (ray.dir * qvec) * inv, t = (e2 * qvec) * inv;
+		if (u >= 0 && v >= 0 && u + v <= 1 && t > ray.tmin && t < ray.tmax) return true;
+	}
+	return false;
+#endif
+}
+
+bool BVH::occluded(const Ray& ray) const {
+	if (nodes.empty()) return false;
+	const float inv[3] = { 1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z };
+	const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	int stack[MAX_DEPTH + 1], sp = 0, idx = 0;
+	for (;;) {
+		const Node& node = nodes[idx];
+		//slab;dirĳΪ0ʱnan,max/minԵ
+		float t0 = ray.tmin, t1 = ray.tmax;
+		for (int a = 0; a < 3; a++) {
+			float ta = (node.lo[a] - origin[a]) * inv[a], tb = (node.hi[a] - origin[a]) * inv[a];
+			if (ta > tb) std::swap(ta, tb);
+			t0 = std::max(t0, ta), t1 = std::min(t1, tb);
+		}
+		if (t0 <= t1) {
+			if (!node.count) {
+				stack[sp++] = node.first;
+				idx++;
+				continue;
+			}
+			for (int i = node.first; i < node.first + node.count; i++)
+				if (occluded(quads[i], ray)) return true;
+		}
+		if (!sp) return false;
+		idx = stack[--sp];
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <limits>
+#include <ostream>
+#include <vector>
+
+#include "geometry.h"
+#include "model.h"
+
+//ֻڵѯĹ,dirعһ,tdirĳΪλ
+struct Ray {
+	vec3 origin, dir;
+	float tmin = 0, tmax = std::numeric_limits<float>::infinity();
+};
+
+struct BVHStats {
+	int triangles = 0, nodes = 0, leaves = 0, depth = 0;
+	double build_ms = 0;
+};
+std::ostream& operator<<(std::ostream& out, const BVHStats& s);
+
+//SAH佨İΧв.Ҷÿ4һ鰴SoA,һһβ4
+class BVH {
+public:
+	//ģ͵γtransform,ȫbuild
+	void add(const Model& model, const mat<4, 4>& transform);
+	void build();
+
+	//[tmin,tmax]һཻͷtrue,
+	bool occluded(const Ray& ray) const;
+	//ΧеĶԽ߳,ƫ
+	float diagonal() const;
+	const BVHStats& stats() const { return st; }
+
+private:
+	//countΪ0ʱڲڵ:ӽں,Һfirst;Ҷ:quads[first]count
+	struct Node {
+		float lo[3];
+		int first;
+		float hi[3];
+		int count;
+	};
+	//4εĶv0e1=v1-v0,e2=v2-v0,4ʱ˻β
+	struct alignas(16) TriangleQuad {
+		float v0[3][4], e1[3][4], e2[3][4];
+	};
+	struct BuildTriangle;
+
+	int build_node(std::vector<BuildTriangle>& tris, int begin, int end, int depth);
+	bool occluded(const TriangleQuad& q, const Ray& ray) const;
+
+	std::vector<vec3> verts;  //build֮ǰ,ÿ3
+	std::vector<Node> nodes;
+	std::vector<TriangleQuad> quads;
+	BVHStats st;
+};
+
+#endif // !BVH_H
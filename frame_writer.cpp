@@ -0,0 +1,207 @@
+#include "frame_writer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+
+ImageFormat format_from_filename(const std::string& filename) {
+	const size_t dot = filename.find_last_of('.');
+	if (dot == std::string::npos) return ImageFormat::TGA;
+	std::string ext = filename.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	if (ext == "png") return ImageFormat::PNG;
+	if (ext == "raw") return ImageFormat::RAW;
+	return ImageFormat::TGA;
+}
+
+static uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc = 0) {
+	static const std::vector<uint32_t> table = [] {
+		std::vector<uint32_t> t(256);
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+	crc = ~crc;
+	for (size_t i = 0; i < n; i++) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put_be32(std::vector<uint8_t>& out, uint32_t v) {
+	for (int s = 24; s >= 0; s -= 8) out.push_back((uint8_t)(v >> s));
+}
+
+//ʾ˳(ϵ)ȡi
+static const uint8_t* display_row(const TGAImage& image, int i, bool vflip) {
+	const int y = vflip ? image.height() - 1 - i : i;
+	return image.buffer() + (size_t)y * image.width() * image.bytespp();
+}
+
+static void encode_png(const TGAImage& image, std::vector<uint8_t>& out, bool vflip) {
+	const int w = image.width(), h = image.height(), bpp = image.bytespp();
+	//ɨ:ÿһ˲ֽ(0)RGB(A)/Ҷ
+	const size_t stride = (size_t)w * bpp + 1;
+	std::vector<uint8_t> raw(stride * h);
+	for (int i = 0; i < h; i++) {
+		uint8_t* dst = raw.data() + i * stride;
+		const uint8_t* src = display_row(image, i, vflip);
+		*dst++ = 0;
+		if (bpp == 1) {
+			std::copy(src, src + w, dst);
+			continue;
+		}
+		for (int x = 0; x < w; x++, src += bpp, dst += bpp) {
+			dst[0] = src[2], dst[1] = src[1], dst[2] = src[0];
+			if (bpp == 4) dst[3] = src[3];
+		}
+	}
+
+	//zlib:ͷ,ѹdeflate(ÿ65535ֽ),adler32
+	std::vector<uint8_t> z = { 0x78, 0x01 };
+	z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	size_t pos = 0;
+	do {
+		const size_t len = std::min<size_t>(65535, raw.size() - pos);
+		z.push_back(pos + len == raw.size() ? 1 : 0);
+		z.push_back((uint8_t)len), z.push_back((uint8_t)(len >> 8));
+		z.push_back((uint8_t)~len), z.push_back((uint8_t)(~len >> 8));
+		z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + len);
+		pos += len;
+	} while (pos < raw.size());
+	uint32_t a = 1, b = 0;
+	for (size_t i = 0; i < raw.size();) {
+		//5552ֽڲ
+		for (const size_t end = std::min(raw.size(), i + 5552); i < end; i++) a += raw[i], b += a;
+		a %= 65521, b %= 65521;
+	}
+	put_be32(z, b << 16 | a);
+
+	auto chunk = [&](const char* type, const uint8_t* data, size_t n) {
+		put_be32(out, (uint32_t)n);
+		const size_t start = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data, data + n);
+		put_be32(out, crc32(out.data() + start, n + 4));
+	};
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	out.assign(signature, signature + 8);
+	std::vector<uint8_t> ihdr;
+	put_be32(ihdr, w), put_be32(ihdr, h);
+	const uint8_t color_type = bpp == 1 ? 0 : bpp == 3 ? 2 : 6;
+	ihdr.insert(ihdr.end(), { 8, color_type, 0, 0, 0 });
+	chunk("IHDR", ihdr.data(), ihdr.size());
+	chunk("IDAT", z.data(), z.size());
+	chunk("IEND", nullptr, 0);
+}
+
+void encode_image(const TGAImage& image, ImageFormat format, std::vector<uint8_t>& out, bool vflip) {
+	switch (format) {
+	case ImageFormat::TGA: image.encode(out, vflip, true); break;
+	case ImageFormat::TGA_RAW: image.encode(out, vflip, false); break;
+	case ImageFormat::PNG: encode_png(image, out, vflip); break;
+	case ImageFormat::RAW: {
+		const size_t row = (size_t)image.width() * image.bytespp();
+		out.resize(row * image.height());
+		for (int i = 0; i < image.height(); i++) std::copy(display_row(image, i, vflip), display_row(image, i, vflip) + row, out.data() + i * row);
+		break;
+	}
+	}
+}
+
+std::ostream& operator<<(std::ostream& out, const WriterStats& s) {
+	out << s.frames << " frames, " << (s.bytes >> 10) << " KB written, " << s.failures << " failures, queue "
+		<< s.queue_depth << " (max " << s.max_queue_depth << "), latency avg "
+		<< (s.frames ? s.latency_ms / s.frames : 0.) << " ms max " << s.max_latency_ms << " ms, encode+write "
+		<< s.encode_ms << " ms, render stalled " << s.stall_ms << " ms";
+	return out;
+}
+
+FrameWriter::FrameWriter(unsigned nthreads, size_t capacity) : capacity(std::max<size_t>(1, capacity)) {
+	for (unsigned i = 0; i < std::max(1u, nthreads); i++) workers.emplace_back([this] { worker_loop(); });
+}
+
+FrameWriter::~FrameWriter() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+	}
+	not_empty.notify_all();
+	for (std::thread& t : workers) t.join();
+}
+
+FrameWriter& FrameWriter::global() {
+	static FrameWriter writer;
+	return writer;
+}
+
+void FrameWriter::submit(const TGAImage& image, const std::string& filename, ImageFormat format, bool vflip) {
+	push({ image, filename, format, vflip, clock::now() });
+}
+
+void FrameWriter::submit(TGAImage&& image, const std::string& filename, ImageFormat format, bool vflip) {
+	push({ std::move(image), filename, format, vflip, clock::now() });
+}
+
+void FrameWriter::push(Job&& job) {
+	std::unique_lock<std::mutex> lock(mtx);
+	if (jobs.size() >= capacity) {
+		const clock::time_point t0 = clock::now();
+		not_full.wait(lock, [this] { return jobs.size() < capacity; });
+		st.stall_ms += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+	}
+	jobs.push_back(std::move(job));
+	st.max_queue_depth = std::max(st.max_queue_depth, jobs.size());
+	lock.unlock();
+	not_empty.notify_one();
+}
+
+void FrameWriter::flush() {
+	std::unique_lock<std::mutex> lock(mtx);
+	idle.wait(lock, [this] { return jobs.empty() && !writing; });
+}
+
+WriterStats FrameWriter::stats() const {
+	std::lock_guard<std::mutex> lock(mtx);
+	WriterStats s = st;
+	s.queue_depth = jobs.size() + writing;
+	return s;
+}
+
+void FrameWriter::worker_loop() {
+	std::vector<uint8_t> buffer;  //ÿд̸߳һ뻺
+	for (;;) {
+		std::unique_lock<std::mutex> lock(mtx);
+		not_empty.wait(lock, [this] { return stop || !jobs.empty(); });
+		//stopҲҪʣµ֡д
+		if (jobs.empty()) return;
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		writing++;
+		lock.unlock();
+		not_full.notify_one();
+
+		const clock::time_point t0 = clock::now();
+		encode_image(job.image, job.format, buffer, job.vflip);
+		std::ofstream out(job.filename, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+		const bool ok = out.good();
+		out.close();
+		if (!ok) std::cerr << "can't write " << job.filename << std::endl;
+		const clock::time_point t1 = clock::now();
+
+		lock.lock();
+		writing--;
+		if (ok) st.frames++, st.bytes += buffer.size();
+		else st.failures++;
+		st.encode_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+		const double latency = std::chrono::duration<double, std::milli>(t1 - job.submitted).count();
+		st.latency_ms += latency;
+		st.max_latency_ms = std::max(st.max_latency_ms, latency);
+		const bool done = jobs.empty() && !writing;
+		lock.unlock();
+		if (done) idle.notify_all();
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tgaimage.h"
+
+enum class ImageFormat {
+	TGA,      //RLEѹTGA
+	TGA_RAW,  //ѹTGA
+	PNG,      //ѹ(stored)deflate,zlib
+	RAW       //ֻֽ,дϵ
+};
+
+//չ¸ʽ,ʶİTGA
+ImageFormat format_from_filename(const std::string& filename);
+//ͼ뵽out,vflipwrite_tga_fileͬ:Ϊtrueʱy=0ͼײ
+void encode_image(const TGAImage& image, ImageFormat format, std::vector<std::uint8_t>& out, bool vflip = true);
+
+//׶εͳ
+struct WriterStats {
+	int frames = 0, failures = 0;
+	size_t bytes = 0;          //д̵ֽ
+	size_t queue_depth = 0;    //ǰŶӵ֡
+	size_t max_queue_depth = 0;
+	double encode_ms = 0;      //+д̵ܺʱ
+	double latency_ms = 0;     //ύдܺʱ
+	double max_latency_ms = 0;
+	double stall_ms = 0;       //ύʱ
+};
+
+std::ostream& operator<<(std::ostream& out, const WriterStats& s);
+
+//첽֡:Ⱦ߳ύͼ,д߳ں̨д
+//,Ժsubmit(),ֹȾԶڴʱ֡ѻռڴ
+//д߳ʱͬļд˳򲻱֤,Ĭһд߳
+class FrameWriter {
+public:
+	explicit FrameWriter(unsigned nthreads = 1, size_t capacity = 4);
+	//дʣµ֡˳
+	~FrameWriter();
+	FrameWriter(const FrameWriter&) = delete;
+	FrameWriter& operator=(const FrameWriter&) = delete;
+
+	//һͼ,÷ϸԼĻ
+	void submit(const TGAImage& image, const std::string& filename, ImageFormat format, bool vflip = true);
+	void submit(TGAImage&& image, const std::string& filename, ImageFormat format, bool vflip = true);
+	void submit(const TGAImage& image, const std::string& filename) { submit(image, filename, format_from_filename(filename)); }
+	//ȵύ֡ȫд,֮԰ȫضЩļ
+	void flush();
+
+	WriterStats stats() const;
+
+	static FrameWriter& global();
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	struct Job {
+		TGAImage image;
+		std::string filename;
+		ImageFormat format;
+		bool vflip;
+		clock::time_point submitted;
+	};
+
+	void push(Job&& job);
+	void worker_loop();
+
+	size_t capacity;
+	std::deque<Job> jobs;
+	int writing = 0;                     //ѳӵûд֡
+	WriterStats st;
+	mutable std::mutex mtx;
+	std::condition_variable not_empty, not_full, idle;
+	bool stop = false;
+	std::vector<std::thread> workers;
+};
+
+#endif // !FRAME_WRITER_H
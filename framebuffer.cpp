@@ -0,0 +1,125 @@
+#include "framebuffer.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+static float* aligned_floats(size_t n) {
+#ifdef _WIN32
+	void* p = _aligned_malloc(n * sizeof(float), PlanePool::ALIGN);
+#else
+	void* p = std::aligned_alloc(PlanePool::ALIGN, n * sizeof(float));
+#endif
+	if (!p) throw std::bad_alloc();
+	return static_cast<float*>(p);
+}
+
+static void free_floats(float* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void fill_depth(float* p, size_t n, float value) {
+	size_t i = 0;
+#ifdef USE_X86_SIMD
+	const __m128 v = _mm_set1_ps(value);
+	for (; i < n && (reinterpret_cast<uintptr_t>(p + i) & 15); i++) p[i] = value;
+	//һдһ64ֽڻ
+	for (; i + 16 <= n; i += 16) {
+		_mm_store_ps(p + i, v);
+		_mm_store_ps(p + i + 4, v);
+		_mm_store_ps(p + i + 8, v);
+		_mm_store_ps(p + i + 12, v);
+	}
+#endif
+	std::fill(p + i, p + n, value);
+}
+
+PlanePool::~PlanePool() {
+	trim();
+}
+
+PlanePool& PlanePool::global() {
+	static PlanePool pool;
+	return pool;
+}
+
+float* PlanePool::acquire(size_t n) {
+	n = padded(n);
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = idle.find(n);
+		if (it != idle.end()) {
+			float* p = it->second;
+			idle.erase(it);
+			return p;
+		}
+	}
+	return aligned_floats(n);
+}
+
+void PlanePool::release(float* p, size_t n) {
+	if (!p) return;
+	std::lock_guard<std::mutex> lock(mtx);
+	idle.emplace(padded(n), p);
+}
+
+size_t PlanePool::idle_bytes() const {
+	std::lock_guard<std::mutex> lock(mtx);
+	size_t bytes = 0;
+	for (const auto& e : idle) bytes += e.first * sizeof(float);
+	return bytes;
+}
+
+void PlanePool::trim() {
+	std::lock_guard<std::mutex> lock(mtx);
+	for (const auto& e : idle) free_floats(e.second);
+	idle.clear();
+}
+
+Framebuffer::Framebuffer(int width, int height, int format, PlanePool& pool)
+	: w(width), h(height), pool(pool), image(width, height, format),
+	  zbuffer(pool.acquire((size_t)width * height)) {
+	clear_depth();
+}
+
+Framebuffer::~Framebuffer() {
+	const size_t n = (size_t)w * h;
+	pool.release(zbuffer, n);
+	for (Attachment& a : extra) pool.release(a.data, n);
+}
+
+float* Framebuffer::attachment(const std::string& name) {
+	for (Attachment& a : extra)
+		if (a.name == name) return a.data;
+	float* p = pool.acquire((size_t)w * h);
+	//嵽ĳ,д
+	fill_depth(p, PlanePool::padded((size_t)w * h), -std::numeric_limits<float>::max());
+	extra.push_back({ name, p });
+	return p;
+}
+
+void Framebuffer::clear() {
+	image.clear();
+	clear_depth();
+	clear_attachments();
+}
+
+void Framebuffer::clear_depth() {
+	fill_depth(zbuffer, PlanePool::padded((size_t)w * h), -std::numeric_limits<float>::max());
+}
+
+void Framebuffer::clear_attachments() {
+	for (Attachment& a : extra)
+		fill_depth(a.data, PlanePool::padded((size_t)w * h), -std::numeric_limits<float>::max());
+}
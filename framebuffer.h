@@ -0,0 +1,78 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tgaimage.h"
+
+//ƽ͸ƽڴ:floatͰ,黹ƽһͬߴ֡
+//ƽ׵ַ64ֽڶ,ȡ16float,ʱҪβ
+class PlanePool {
+public:
+	static constexpr size_t ALIGN = 64;
+
+	PlanePool() = default;
+	~PlanePool();
+	PlanePool(const PlanePool&) = delete;
+	PlanePool& operator=(const PlanePool&) = delete;
+
+	//ûͬߴƽʱ,δʼ
+	float* acquire(size_t n);
+	void release(float* p, size_t n);
+	//õֽ
+	size_t idle_bytes() const;
+	//ͷƽ
+	void trim();
+
+	static size_t padded(size_t n) { return (n + 15) & ~size_t(15); }
+	static PlanePool& global();
+
+private:
+	std::multimap<size_t, float*> idle;
+	mutable std::mutex mtx;
+};
+
+//֡:ɫͼ+ƽ+ѡfloat(Ӱͼ)
+//ȳʼΪ-max(zԽԽ),һȡʱ䲢ͬ-max
+//ͬһڶ֡/ε䷴clear(),ʱƽ滹
+class Framebuffer {
+public:
+	Framebuffer(int width, int height, int format = TGAImage::RGB, PlanePool& pool = PlanePool::global());
+	~Framebuffer();
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	int width() const { return w; }
+	int height() const { return h; }
+	TGAImage& color() { return image; }
+	const TGAImage& color() const { return image; }
+	float* depth() { return zbuffer; }
+	//ʱ
+	float* attachment(const std::string& name);
+
+	//ɫ0,Ⱥи-max
+	void clear();
+	void clear_depth();
+	void clear_attachments();
+
+private:
+	struct Attachment {
+		std::string name;
+		float* data;
+	};
+
+	int w, h;
+	PlanePool& pool;
+	TGAImage image;
+	float* zbuffer;
+	std::vector<Attachment> extra;
+};
+
+//SIMDnfloatдvalue,pҪ16ֽڶn4ıʱ
+void fill_depth(float* p, size_t n, float value);
+
+#endif // !FRAMEBUFFER_H
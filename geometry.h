@@ -2,238 +2,358 @@
 #include <cmath>
 #include <cassert>
 #include <iostream>
+#include "simd.h"
 
-template<int n> struct vec {
+// the scalar type is a template parameter; rendering uses the float default
+template<typename T> struct nondeduced { typedef T type; };
+template<typename T> using scalar_t = typename nondeduced<T>::type;
+
+template<int n, typename T=float> struct vec {
     vec() = default;
-    double & operator[](const int i)       { assert(i>=0 && i<n); return data[i]; }
-    double   operator[](const int i) const { assert(i>=0 && i<n); return data[i]; }
-    double norm2() const { return *this * *this; }
-    double norm()  const { return std::sqrt(norm2()); }
-    double data[n] = {0};
+    constexpr T & operator[](const int i)       { assert(i>=0 && i<n); return data[i]; }
+    constexpr T   operator[](const int i) const { assert(i>=0 && i<n); return data[i]; }
+    T norm2() const { return *this * *this; }
+    T norm()  const { return std::sqrt(norm2()); }
+    T data[n] = {0};
 };
 
-template<int n> double operator*(const vec<n>& lhs, const vec<n>& rhs) {
-    double ret = 0;
+template<int n, typename T> T operator*(const vec<n,T>& lhs, const vec<n,T>& rhs) {
+    T ret = 0;
     for (int i=n; i--; ret+=lhs[i]*rhs[i]);
     return ret;
 }
 
-template<int n> vec<n> operator+(const vec<n>& lhs, const vec<n>& rhs) {
-    vec<n> ret = lhs;
+template<int n, typename T> vec<n,T> operator+(const vec<n,T>& lhs, const vec<n,T>& rhs) {
+    vec<n,T> ret = lhs;
     for (int i=n; i--; ret[i]+=rhs[i]);
     return ret;
 }
 
-template<int n> vec<n> operator-(const vec<n>& lhs, const vec<n>& rhs) {
-    vec<n> ret = lhs;
+template<int n, typename T> vec<n,T> operator-(const vec<n,T>& lhs, const vec<n,T>& rhs) {
+    vec<n,T> ret = lhs;
     for (int i=n; i--; ret[i]-=rhs[i]);
     return ret;
 }
 
-template<int n> vec<n> operator*(const double& rhs, const vec<n> &lhs) {
-    vec<n> ret = lhs;
+template<int n, typename T> vec<n,T> operator*(const scalar_t<T>& rhs, const vec<n,T> &lhs) {
+    vec<n,T> ret = lhs;
     for (int i=n; i--; ret[i]*=rhs);
     return ret;
 }
 
-template<int n> vec<n> operator*(const vec<n>& lhs, const double& rhs) {
-    vec<n> ret = lhs;
+template<int n, typename T> vec<n,T> operator*(const vec<n,T>& lhs, const scalar_t<T>& rhs) {
+    vec<n,T> ret = lhs;
     for (int i=n; i--; ret[i]*=rhs);
     return ret;
 }
 
-template<int n> vec<n> operator/(const vec<n>& lhs, const double& rhs) {
-    vec<n> ret = lhs;
+template<int n, typename T> vec<n,T> operator/(const vec<n,T>& lhs, const scalar_t<T>& rhs) {
+    vec<n,T> ret = lhs;
     for (int i=n; i--; ret[i]/=rhs);
     return ret;
 }
 
-template<int n1,int n2> vec<n1> embed(const vec<n2> &v, double fill=1) {
-    vec<n1> ret;
+template<int n1,int n2, typename T> vec<n1,T> embed(const vec<n2,T> &v, scalar_t<T> fill=1) {
+    vec<n1,T> ret;
     for (int i=n1; i--; ret[i]=(i<n2?v[i]:fill));
     return ret;
 }
 
-template<int n1,int n2> vec<n1> proj(const vec<n2> &v) {
-    vec<n1> ret;
+template<int n1,int n2, typename T> vec<n1,T> proj(const vec<n2,T> &v) {
+    vec<n1,T> ret;
     for (int i=n1; i--; ret[i]=v[i]);
     return ret;
 }
 
 
-template<int n> std::ostream& operator<<(std::ostream& out, const vec<n>& v) {
+template<int n, typename T> std::ostream& operator<<(std::ostream& out, const vec<n,T>& v) {
     for (int i=0; i<n; i++) out << v[i] << " ";
     return out;
 }
 
-template<> struct vec<2> {
+template<typename T> struct vec<2,T> {
     vec() = default;
-    vec(double x, double y) : x(x), y(y) {}
-    double& operator[](const int i)       { assert(i>=0 && i<2); return i ? y : x; }
-    double  operator[](const int i) const { assert(i>=0 && i<2); return i ? y : x; }
-    double norm2() const { return *this * *this; }
-    double norm()  const { return std::sqrt(norm2()); }
+    constexpr vec(T x, T y) : x(x), y(y) {}
+    constexpr T& operator[](const int i)       { assert(i>=0 && i<2); return i ? y : x; }
+    constexpr T  operator[](const int i) const { assert(i>=0 && i<2); return i ? y : x; }
+    T norm2() const { return *this * *this; }
+    T norm()  const { return std::sqrt(norm2()); }
     vec & normalize() { *this = (*this)/norm(); return *this; }
 
-    double x{}, y{};
+    T x{}, y{};
 };
 
-template<> struct vec<3> {
+template<typename T> struct vec<3,T> {
     vec() = default;
-    vec(double x, double y, double z) : x(x), y(y), z(z) {}
-    double& operator[](const int i)       { assert(i>=0 && i<3); return i ? (1==i ? y : z) : x; }
-    double  operator[](const int i) const { assert(i>=0 && i<3); return i ? (1==i ? y : z) : x; }
-    double norm2() const { return *this * *this; }
-    double norm()  const { return std::sqrt(norm2()); }
+    constexpr vec(T x, T y, T z) : x(x), y(y), z(z) {}
+    constexpr T& operator[](const int i)       { assert(i>=0 && i<3); return i ? (1==i ? y : z) : x; }
+    constexpr T  operator[](const int i) const { assert(i>=0 && i<3); return i ? (1==i ? y : z) : x; }
+    T norm2() const { return *this * *this; }
+    T norm()  const { return std::sqrt(norm2()); }
     vec & normalize() { *this = (*this)/norm(); return *this; }
 
-    double x{}, y{}, z{};
+    T x{}, y{}, z{};
 };
 
-template<> struct vec<4> {
+// 16-byte aligned so that vec<4,float> is exactly one SSE register
+template<typename T> struct alignas(16) vec<4,T> {
     union{
-        double data[4];
+        T data[4];
         struct {
-            double x, y, z, w;
+            T x, y, z, w;
         };
         struct {
-            double r, g, b, a;
+            T r, g, b, a;
         };
     };
     vec() = default;
-    vec(double x, double y, double z,double w) : x(x), y(y), z(z),w(w) {}
-    double& operator[](const int i) { assert(i >= 0 && i < 4); return data[i]; }
-    double  operator[](const int i) const { assert(i >= 0 && i < 4); return data[i]; }
-    double norm2() const { return *this * *this; }
-    double norm()  const { return std::sqrt(norm2()); }
+    constexpr vec(T x, T y, T z, T w) : data{x, y, z, w} {}
+    constexpr T& operator[](const int i) { assert(i >= 0 && i < 4); return data[i]; }
+    constexpr T  operator[](const int i) const { assert(i >= 0 && i < 4); return data[i]; }
+    T norm2() const { return *this * *this; }
+    T norm()  const { return std::sqrt(norm2()); }
     vec& normalize() { *this = (*this) / norm(); return *this; }
 };
 
 typedef vec<2> vec2;
 typedef vec<3> vec3;
 typedef vec<4> vec4;
-vec3 cross(const vec3 &v1, const vec3 &v2);
+typedef vec<2,double> dvec2;
+typedef vec<3,double> dvec3;
+typedef vec<4,double> dvec4;
 
-template<int n> struct dt;
+template<typename T> vec<3,T> cross(const vec<3,T> &v1, const vec<3,T> &v2) {
+    return vec<3,T>{v1.y*v2.z - v1.z*v2.y, v1.z*v2.x - v1.x*v2.z, v1.x*v2.y - v1.y*v2.x};
+}
 
-template<int nrows,int ncols> struct mat {
-    vec<ncols> rows[nrows] = {{}};
+// vec<4,float> dot/cross/normalize on SSE; the scalar fallbacks use the same summation order
+// (x*x'+y*y')+(z*z'+w*w') so that SIMD and non-SIMD builds produce identical results
+#ifdef USE_X86_SIMD
+inline __m128 hsum4(__m128 p) {
+    __m128 s = _mm_add_ps(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2,3,0,1))); // (x+y, y+x, z+w, w+z)
+    return _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1,0,3,2)));     // (x+y)+(z+w) in every lane
+}
 
-          vec<ncols>& operator[] (const int idx)       { assert(idx>=0 && idx<nrows); return rows[idx]; }
-    const vec<ncols>& operator[] (const int idx) const { assert(idx>=0 && idx<nrows); return rows[idx]; }
+inline float operator*(const vec<4,float>& lhs, const vec<4,float>& rhs) {
+    return _mm_cvtss_f32(hsum4(_mm_mul_ps(_mm_load_ps(lhs.data), _mm_load_ps(rhs.data))));
+}
 
-    vec<nrows> col(const int idx) const {
+template<> inline vec<4,float>& vec<4,float>::normalize() {
+    __m128 v = _mm_load_ps(data);
+    _mm_store_ps(data, _mm_div_ps(v, _mm_sqrt_ps(hsum4(_mm_mul_ps(v, v)))));
+    return *this;
+}
+
+// cross product of the xyz parts, w of the result is 0
+inline vec<4,float> cross(const vec<4,float>& v1, const vec<4,float>& v2) {
+    __m128 a = _mm_load_ps(v1.data), b = _mm_load_ps(v2.data);
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1)), b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+    __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,1,0,2)), b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,1,0,2));
+    vec<4,float> ret;
+    _mm_store_ps(ret.data, _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+    return ret;
+}
+#else
+inline float operator*(const vec<4,float>& lhs, const vec<4,float>& rhs) {
+    return (lhs.x*rhs.x + lhs.y*rhs.y) + (lhs.z*rhs.z + lhs.w*rhs.w);
+}
+
+template<> inline vec<4,float>& vec<4,float>::normalize() {
+    float n = std::sqrt(*this * *this);
+    for (int i=4; i--; data[i]/=n);
+    return *this;
+}
+
+inline vec<4,float> cross(const vec<4,float>& v1, const vec<4,float>& v2) {
+    return {v1.y*v2.z - v1.z*v2.y, v1.z*v2.x - v1.x*v2.z, v1.x*v2.y - v1.y*v2.x, 0.f};
+}
+#endif
+
+template<int n, typename T> struct dt;
+
+template<int nrows,int ncols, typename T=float> struct mat {
+    vec<ncols,T> rows[nrows] = {{}};
+
+    constexpr       vec<ncols,T>& operator[] (const int idx)       { assert(idx>=0 && idx<nrows); return rows[idx]; }
+    constexpr const vec<ncols,T>& operator[] (const int idx) const { assert(idx>=0 && idx<nrows); return rows[idx]; }
+
+    vec<nrows,T> col(const int idx) const {
         assert(idx>=0 && idx<ncols);
-        vec<nrows> ret;
+        vec<nrows,T> ret;
         for (int i=nrows; i--; ret[i]=rows[i][idx]);
         return ret;
     }
 
-    void set_col(const int idx, const vec<nrows> &v) {
+    void set_col(const int idx, const vec<nrows,T> &v) {
         assert(idx>=0 && idx<ncols);
         for (int i=nrows; i--; rows[i][idx]=v[i]);
     }
 
-    static mat<nrows,ncols> identity() {
-        mat<nrows,ncols> ret;
+    static mat<nrows,ncols,T> identity() {
+        mat<nrows,ncols,T> ret;
         for (int i=nrows; i--; )
             for (int j=ncols;j--; ret[i][j]=(i==j));
         return ret;
     }
 
-    double det() const {
-        return dt<ncols>::det(*this);
+    T det() const {
+        return dt<ncols,T>::det(*this);
     }
 
-    mat<nrows-1,ncols-1> get_minor(const int row, const int col) const {
-        mat<nrows-1,ncols-1> ret;
+    mat<nrows-1,ncols-1,T> get_minor(const int row, const int col) const {
+        mat<nrows-1,ncols-1,T> ret;
         for (int i=nrows-1; i--; )
             for (int j=ncols-1;j--; ret[i][j]=rows[i<row?i:i+1][j<col?j:j+1]);
         return ret;
     }
 
-    double cofactor(const int row, const int col) const {
+    T cofactor(const int row, const int col) const {
         return get_minor(row,col).det()*((row+col)%2 ? -1 : 1);
     }
 
-    mat<nrows,ncols> adjugate() const {
-        mat<nrows,ncols> ret;
+    mat<nrows,ncols,T> adjugate() const {
+        mat<nrows,ncols,T> ret;
         for (int i=nrows; i--; )
             for (int j=ncols; j--; ret[i][j]=cofactor(i,j));
         return ret;
     }
 
-    mat<nrows,ncols> invert_transpose() const {
-        mat<nrows,ncols> ret = adjugate();
+    mat<nrows,ncols,T> invert_transpose() const {
+        mat<nrows,ncols,T> ret = adjugate();
         return ret/(ret[0]*rows[0]);
     }
 
-    mat<nrows,ncols> invert() const {
+    mat<nrows,ncols,T> invert() const {
         return invert_transpose().transpose();
     }
 
-    mat<ncols,nrows> transpose() const {
-        mat<ncols,nrows> ret;
+    mat<ncols,nrows,T> transpose() const {
+        mat<ncols,nrows,T> ret;
         for (int i=ncols; i--; ret[i]=this->col(i));
         return ret;
     }
 };
 
-template<int nrows,int ncols> vec<nrows> operator*(const mat<nrows,ncols>& lhs, const vec<ncols>& rhs) {
-    vec<nrows> ret;
+template<int nrows,int ncols, typename T> vec<nrows,T> operator*(const mat<nrows,ncols,T>& lhs, const vec<ncols,T>& rhs) {
+    vec<nrows,T> ret;
     for (int i=nrows; i--; ret[i]=lhs[i]*rhs);
     return ret;
 }
 
-template<int R1,int C1,int C2>mat<R1,C2> operator*(const mat<R1,C1>& lhs, const mat<C1,C2>& rhs) {
-    mat<R1,C2> result;
+// every row dotted with rhs at once: transpose the products and add the columns pairwise
+#ifdef USE_X86_SIMD
+inline vec<4,float> operator*(const mat<4,4,float>& lhs, const vec<4,float>& rhs) {
+    __m128 v = _mm_load_ps(rhs.data);
+    __m128 p0 = _mm_mul_ps(_mm_load_ps(lhs.rows[0].data), v), p1 = _mm_mul_ps(_mm_load_ps(lhs.rows[1].data), v);
+    __m128 p2 = _mm_mul_ps(_mm_load_ps(lhs.rows[2].data), v), p3 = _mm_mul_ps(_mm_load_ps(lhs.rows[3].data), v);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    vec<4,float> ret;
+    _mm_store_ps(ret.data, _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+    return ret;
+}
+#endif
+
+template<int R1,int C1,int C2, typename T>mat<R1,C2,T> operator*(const mat<R1,C1,T>& lhs, const mat<C1,C2,T>& rhs) {
+    mat<R1,C2,T> result;
     for (int i=R1; i--; )
         for (int j=C2; j--; result[i][j]=lhs[i]*rhs.col(j));
     return result;
 }
 
-template<int nrows,int ncols>mat<nrows,ncols> operator*(const mat<nrows,ncols>& lhs, const double& val) {
-    mat<nrows,ncols> result;
+template<int nrows,int ncols, typename T>mat<nrows,ncols,T> operator*(const mat<nrows,ncols,T>& lhs, const scalar_t<T>& val) {
+    mat<nrows,ncols,T> result;
     for (int i=nrows; i--; result[i] = lhs[i]*val);
     return result;
 }
 
-template<int nrows,int ncols>mat<nrows,ncols> operator/(const mat<nrows,ncols>& lhs, const double& val) {
-    mat<nrows,ncols> result;
+template<int nrows,int ncols, typename T>mat<nrows,ncols,T> operator/(const mat<nrows,ncols,T>& lhs, const scalar_t<T>& val) {
+    mat<nrows,ncols,T> result;
     for (int i=nrows; i--; result[i] = lhs[i]/val);
     return result;
 }
 
-template<int nrows,int ncols>mat<nrows,ncols> operator+(const mat<nrows,ncols>& lhs, const mat<nrows,ncols>& rhs) {
-    mat<nrows,ncols> result;
+template<int nrows,int ncols, typename T>mat<nrows,ncols,T> operator+(const mat<nrows,ncols,T>& lhs, const mat<nrows,ncols,T>& rhs) {
+    mat<nrows,ncols,T> result;
     for (int i=nrows; i--; )
         for (int j=ncols; j--; result[i][j]=lhs[i][j]+rhs[i][j]);
     return result;
 }
 
-template<int nrows,int ncols>mat<nrows,ncols> operator-(const mat<nrows,ncols>& lhs, const mat<nrows,ncols>& rhs) {
-    mat<nrows,ncols> result;
+template<int nrows,int ncols, typename T>mat<nrows,ncols,T> operator-(const mat<nrows,ncols,T>& lhs, const mat<nrows,ncols,T>& rhs) {
+    mat<nrows,ncols,T> result;
     for (int i=nrows; i--; )
         for (int j=ncols; j--; result[i][j]=lhs[i][j]-rhs[i][j]);
     return result;
 }
 
-template<int nrows,int ncols> std::ostream& operator<<(std::ostream& out, const mat<nrows,ncols>& m) {
+template<int nrows,int ncols, typename T> std::ostream& operator<<(std::ostream& out, const mat<nrows,ncols,T>& m) {
     for (int i=0; i<nrows; i++) out << m[i] << std::endl;
     return out;
 }
 
-template<int n> struct dt {
-    static double det(const mat<n,n>& src) {
-        double ret = 0;
+template<int n, typename T> struct dt {
+    static T det(const mat<n,n,T>& src) {
+        T ret = 0;
         for (int i=n; i--; ret += src[0][i]*src.cofactor(0,i));
         return ret;
     }
 };
 
-template<> struct dt<1> {
-    static double det(const mat<1,1>& src) {
+template<typename T> struct dt<1,T> {
+    static T det(const mat<1,1,T>& src) {
         return src[0][0];
     }
 };
 
+// closed-form inverses: no recursion through dt<n>/cofactor, usable in constant expressions
+template<typename T> constexpr mat<3,3,T> inverse(const mat<3,3,T>& m) {
+    mat<3,3,T> ret;
+    ret[0][0] = m[1][1]*m[2][2] - m[1][2]*m[2][1];
+    ret[0][1] = m[0][2]*m[2][1] - m[0][1]*m[2][2];
+    ret[0][2] = m[0][1]*m[1][2] - m[0][2]*m[1][1];
+    ret[1][0] = m[1][2]*m[2][0] - m[1][0]*m[2][2];
+    ret[1][1] = m[0][0]*m[2][2] - m[0][2]*m[2][0];
+    ret[1][2] = m[0][2]*m[1][0] - m[0][0]*m[1][2];
+    ret[2][0] = m[1][0]*m[2][1] - m[1][1]*m[2][0];
+    ret[2][1] = m[0][1]*m[2][0] - m[0][0]*m[2][1];
+    ret[2][2] = m[0][0]*m[1][1] - m[0][1]*m[1][0];
+    const T inv_det = T(1)/(m[0][0]*ret[0][0] + m[0][1]*ret[1][0] + m[0][2]*ret[2][0]);
+    for (int i=0; i<3; i++)
+        for (int j=0; j<3; j++) ret[i][j] *= inv_det;
+    return ret;
+}
+
+template<typename T> constexpr mat<4,4,T> inverse(const mat<4,4,T>& m) {
+    // 2x2 sub-determinants of the top two and bottom two rows
+    const T s0 = m[0][0]*m[1][1] - m[1][0]*m[0][1];
+    const T s1 = m[0][0]*m[1][2] - m[1][0]*m[0][2];
+    const T s2 = m[0][0]*m[1][3] - m[1][0]*m[0][3];
+    const T s3 = m[0][1]*m[1][2] - m[1][1]*m[0][2];
+    const T s4 = m[0][1]*m[1][3] - m[1][1]*m[0][3];
+    const T s5 = m[0][2]*m[1][3] - m[1][2]*m[0][3];
+    const T c5 = m[2][2]*m[3][3] - m[3][2]*m[2][3];
+    const T c4 = m[2][1]*m[3][3] - m[3][1]*m[2][3];
+    const T c3 = m[2][1]*m[3][2] - m[3][1]*m[2][2];
+    const T c2 = m[2][0]*m[3][3] - m[3][0]*m[2][3];
+    const T c1 = m[2][0]*m[3][2] - m[3][0]*m[2][2];
+    const T c0 = m[2][0]*m[3][1] - m[3][0]*m[2][1];
+    const T inv_det = T(1)/(s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0);
+    mat<4,4,T> ret;
+    ret[0][0] = ( m[1][1]*c5 - m[1][2]*c4 + m[1][3]*c3)*inv_det;
+    ret[0][1] = (-m[0][1]*c5 + m[0][2]*c4 - m[0][3]*c3)*inv_det;
+    ret[0][2] = ( m[3][1]*s5 - m[3][2]*s4 + m[3][3]*s3)*inv_det;
+    ret[0][3] = (-m[2][1]*s5 + m[2][2]*s4 - m[2][3]*s3)*inv_det;
+    ret[1][0] = (-m[1][0]*c5 + m[1][2]*c2 - m[1][3]*c1)*inv_det;
+    ret[1][1] = ( m[0][0]*c5 - m[0][2]*c2 + m[0][3]*c1)*inv_det;
+    ret[1][2] = (-m[3][0]*s5 + m[3][2]*s2 - m[3][3]*s1)*inv_det;
+    ret[1][3] = ( m[2][0]*s5 - m[2][2]*s2 + m[2][3]*s1)*inv_det;
+    ret[2][0] = ( m[1][0]*c4 - m[1][1]*c2 + m[1][3]*c0)*inv_det;
+    ret[2][1] = (-m[0][0]*c4 + m[0][1]*c2 - m[0][3]*c0)*inv_det;
+    ret[2][2] = ( m[3][0]*s4 - m[3][1]*s2 + m[3][3]*s0)*inv_det;
+    ret[2][3] = (-m[2][0]*s4 + m[2][1]*s2 - m[2][3]*s0)*inv_det;
+    ret[3][0] = (-m[1][0]*c3 + m[1][1]*c1 - m[1][2]*c0)*inv_det;
+    ret[3][1] = ( m[0][0]*c3 - m[0][1]*c1 + m[0][2]*c0)*inv_det;
+    ret[3][2] = (-m[3][0]*s3 + m[3][1]*s1 - m[3][2]*s0)*inv_det;
+    ret[3][3] = ( m[2][0]*s3 - m[2][1]*s1 + m[2][2]*s0)*inv_det;
+    return ret;
+}
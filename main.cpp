@@ -1,12 +1,27 @@
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <string>
+#include <vector>
 
 #include "tgaimage.h"
 #include "model.h"
 #include "geometry.h"
 #include "our_gl.h"
 #include "shader.h"
+#include "tile_rasterizer.h"
+#include "asset_manager.h"
+#include "bvh.h"
+#include "framebuffer.h"
+#include "frame_writer.h"
+#include "sampling.h"
+#include "scene.h"
+#include "texel_map.h"
+#include "thread_pool.h"
 
 
 TGAColor WHITE(255, 255, 255, 255);
@@ -14,413 +29,676 @@ TGAColor RED(255, 0, 0, 255);
 TGAColor GREEN(0, 255, 0, 255);
 TGAColor BLUE(0, 0, 255, 255);
 
-constexpr int WIDTH = 800;
-constexpr int HEIGHT = 800;
-
-vec3 EYE = { 0,0,3 };
-vec3 CENTER = { 0,0,0 };
+//ӿھ,ռjob.zoom
+mat<4, 4> get_viewport(const RenderJob& job) {
+	const float margin = (1 - job.zoom) / 2;
+	return get_viewport(int(job.width * margin), int(job.height * margin), int(job.width * job.zoom), int(job.height * job.zoom));
+}
 
-void render_shadow(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return ;
-	}
+mat<4, 4> get_model(const RenderJob& job) {
+	return job.yaw ? get_rotate(vec3(0, 1, 0), job.yaw) : mat<4, 4>::identity();
+}
 
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void render_shadow(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
 	std::array<vec3, 3> world_coords, normals;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 
-	Light light;
-	light.position = vec3(3, 3, 0);
-	light.direction = vec3(-2, 2, 2);
-	light.ambient = 0.1 * vec3(255, 255, 255);
-	light.diffuse = vec3(255, 255, 255);
-	light.specular = vec3(255, 255, 255);
+	const Light& light = job.light;
+	const Material& material = job.material;
 
-	Material material;
-	material.ambient = material.diffuse = material.specular = vec3(255, 231, 111);
-	material.shininess = 32;
-
-	float* zbuffer = new float[HEIGHT * WIDTH], * shadow_buffer = new float[HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
-	for (int i = 0; i < HEIGHT * WIDTH; i++) shadow_buffer[i] = -std::numeric_limits<float>::max();
+	float* zbuffer = fb.depth(), * shadow_buffer = fb.attachment("shadow");
 
 	DeepthShader deepth_shader;
 	ShadowShader shadow_shader;
-	for (int n = 1; n < argc; n++) {
+	deepth_shader.cull_face = shadow_shader.cull_face = job.cull;
+	TileRasterizer<DeepthShader> deepth_raster(job.width, job.height);
+	TileRasterizer<ShadowShader> shadow_raster(job.width, job.height);
+	for (const std::string& file : job.models) {
 		//Model model(R"(D:\code\MyTinyRenderer\obj\spot_triangulated_good.obj)");
-		Model model(argv[n]);
-		deepth_shader.projection = mat<4, 4>::identity();
-		deepth_shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		deepth_shader.lookat = get_lookat(light.position, CENTER, vec3(0, 1, 0));
-		deepth_shader.model = mat<4, 4>::identity();
-
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		deepth_shader.uniforms.set_projection(mat<4, 4>::identity());
+		deepth_shader.uniforms.set_viewport(get_viewport(job));
+		deepth_shader.uniforms.set_lookat(get_lookat(light.position, job.center, job.up));
+		deepth_shader.uniforms.set_model(get_model(job));
+
+		vb.transform(*model, deepth_shader.uniforms.mvp());
+		deepth_raster.bind(deepth_shader);
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				normals[ivert] = model.normal(iface, ivert).normalize();
+				world_coords[ivert] = model->vert(iface, ivert);
+				normals[ivert] = model->normal(iface, ivert).normalize();
 			}
-			screen_coords = deepth_shader.vertex(world_coords);
-			triangle(screen_coords, deepth_shader, shadow_buffer, image);
+			screen_coords = deepth_shader.vertex(world_coords, vb.triangle(*model, iface));
+			deepth_raster.triangle(screen_coords, deepth_shader);
 		}
 	}
-
-	for (int n = 1; n < argc; n++) {
-		Model model(argv[n]);
-		shadow_shader.projection = get_projection(EYE, CENTER);
-		shadow_shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		shadow_shader.lookat = get_lookat(EYE, CENTER, vec3(0, 1, 0));
-		shadow_shader.model = mat<4, 4>::identity();
-		shadow_shader.deepth_matrix = deepth_shader.viewport * deepth_shader.projection * deepth_shader.lookat * deepth_shader.model;
+	deepth_raster.flush(shadow_buffer, image);
+
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shadow_shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shadow_shader.uniforms.set_viewport(get_viewport(job));
+		shadow_shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shadow_shader.uniforms.set_model(get_model(job));
+		shadow_shader.uniforms.set_light_space(deepth_shader.uniforms.mvp());
 		shadow_shader.light = light;
 		shadow_shader.material = material;
-		shadow_shader.eye = EYE;
+		shadow_shader.eye = job.eye;
 		shadow_shader.shadow_buffer = shadow_buffer;
-		shadow_shader.dim = vec2(WIDTH, HEIGHT);
+		shadow_shader.dim = vec2(job.width, job.height);
 
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+		vb.transform(*model, shadow_shader.uniforms.mvp());
+		shadow_raster.bind(shadow_shader);
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				normals[ivert] = model.normal(iface, ivert).normalize();
+				world_coords[ivert] = model->vert(iface, ivert);
+				normals[ivert] = model->normal(iface, ivert).normalize();
 			}
 			shadow_shader.normals = normals;
-			screen_coords = shadow_shader.vertex(world_coords);
-			triangle(screen_coords, shadow_shader, zbuffer, image);
+			screen_coords = shadow_shader.vertex(world_coords, vb.triangle(*model, iface));
+			shadow_raster.triangle(screen_coords, shadow_shader);
 		}
 
 	}
+	shadow_raster.flush(zbuffer, image);
+	std::cerr << "depth pass: " << deepth_raster.stats() << std::endl;
+	std::cerr << "color pass: " << shadow_raster.stats() << std::endl;
 
 	//image.flip_vertically();
-	image.write_tga_file("output.tga");
+	FrameWriter::global().submit(image, job.output);
 }
 
-void render_texture(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return;
-	}
-
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void render_texture(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
 	std::array<vec3, 3> world_coords;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 	std::array<vec2, 3> uvs;
 
-	float* zbuffer = new float[HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
+	float* zbuffer = fb.depth();
+	HierarchicalZ hiz(zbuffer, job.width, job.height);
 	
 	TextureShader shader;
-	for (int n = 1; n < argc; n++) {
-		Model model(argv[n]);
-		shader.projection = get_projection(vec3(2,0,3), CENTER);
-		shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		shader.lookat = get_lookat(vec3(2,0,3), CENTER, vec3(0, 1, 0));
-		shader.model = mat<4, 4>::identity();
-
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+	shader.cull_face = job.cull;
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shader.uniforms.set_viewport(get_viewport(job));
+		shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shader.uniforms.set_model(get_model(job));
+		shader.texture = model->diffuse();
+
+		vb.transform(*model, shader.uniforms.mvp());
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				uvs[ivert] = model.uv(iface, ivert);
+				world_coords[ivert] = model->vert(iface, ivert);
+				uvs[ivert] = model->uv(iface, ivert);
 			}
 			shader.uvs = uvs;
-			shader.texture = model.diffuse();
-			screen_coords = shader.vertex(world_coords);
-			triangle(screen_coords, shader, zbuffer, image);
+			screen_coords = shader.vertex(world_coords, vb.triangle(*model, iface));
+			draw(screen_coords, shader, hiz, image);
 		}
 	}
 
 	
 
+	std::cerr << "hiz: " << hiz.stats << std::endl;
 	//image.flip_vertically();
-	image.write_tga_file("output.tga");
+	FrameWriter::global().submit(image, job.output);
 }
 
-void render_phong(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return;
-	}
-
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void render_phong(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
 	std::array<vec3, 3> world_coords, normals;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 	std::array<vec2, 3> uvs;
 
-	Light light;
-	light.position = vec3(3, 3, 0);
-	light.direction = vec3(-2, 2, 2);
-	light.ambient = 0.1 * vec3(255, 255, 255);
-	light.diffuse = vec3(255, 255, 255);
-	light.specular = vec3(255, 255, 255);
-
-	Material material;
-	material.ambient = material.diffuse = material.specular = vec3(249, 210, 228);
-	material.shininess = 32;
+	const Light& light = job.light;
+	const Material& material = job.material;
 
-	float* zbuffer = new float[HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
+	float* zbuffer = fb.depth();
 
 
 
 	PhoneLightShader shader;
-	for (int n = 1; n < argc; n++) {
-		Model model(argv[n]);
-		shader.projection = get_projection(EYE, CENTER);
-		shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		shader.lookat = get_lookat(EYE, CENTER, vec3(0, 1, 0));
-		shader.model = get_rotate(vec3(0,1,0),45);
-		shader.eye = EYE;
+	shader.cull_face = job.cull;
+	TileRasterizer<PhoneLightShader> raster(job.width, job.height);
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shader.uniforms.set_viewport(get_viewport(job));
+		shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shader.uniforms.set_model(get_model(job));
+		shader.eye = job.eye;
 		shader.material = material;
 		shader.light = light;
 		
 
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+		vb.transform(*model, shader.uniforms.mvp());
+		raster.bind(shader);
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				normals[ivert] = model.normal(iface, ivert).normalize();
-				uvs[ivert] = model.uv(iface, ivert);
+				world_coords[ivert] = model->vert(iface, ivert);
+				normals[ivert] = model->normal(iface, ivert).normalize();
+				uvs[ivert] = model->uv(iface, ivert);
 			}
 			shader.normals = normals;
-			screen_coords = shader.vertex(world_coords);
-			triangle(screen_coords, shader, zbuffer, image);
+			screen_coords = shader.vertex(world_coords, vb.triangle(*model, iface));
+			raster.triangle(screen_coords, shader);
 		}
 	}
+	raster.flush(zbuffer, image);
+	std::cerr << "hiz: " << raster.stats() << std::endl;
 
 
 
-	image.write_tga_file("output.tga");
+	FrameWriter::global().submit(image, job.output);
 }
 
-void render_normal(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return;
-	}
-
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void render_normal(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
 	std::array<vec3, 3> world_coords, normals;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 
-	float* zbuffer = new float[HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
+	float* zbuffer = fb.depth();
 
 	NormalShader shader;
-	for (int n = 1; n < argc; n++) {
-		Model model(argv[n]);
-		shader.projection = get_projection(EYE, CENTER);
-		shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		shader.lookat = get_lookat(EYE, CENTER, vec3(0, 1, 0));
-		shader.model = get_rotate(vec3(0, 1, 0), 45);
-
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+	shader.cull_face = job.cull;
+	TileRasterizer<NormalShader> raster(job.width, job.height);
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shader.uniforms.set_viewport(get_viewport(job));
+		shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shader.uniforms.set_model(get_model(job));
+
+		vb.transform(*model, shader.uniforms.mvp());
+		raster.bind(shader);
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				normals[ivert] = model.normal(iface, ivert).normalize();
+				world_coords[ivert] = model->vert(iface, ivert);
+				normals[ivert] = model->normal(iface, ivert).normalize();
 			}
 			shader.normals = normals;
-			screen_coords = shader.vertex(world_coords);
-			triangle(screen_coords, shader, zbuffer, image);
+			screen_coords = shader.vertex(world_coords, vb.triangle(*model, iface));
+			raster.triangle(screen_coords, shader);
 		}
 	}
+	raster.flush(zbuffer, image);
+	std::cerr << "hiz: " << raster.stats() << std::endl;
 
-	image.write_tga_file("output.tga");
+	FrameWriter::global().submit(image, job.output);
 }
 
-void ssaa_render_phong(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return;
-	}
-
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void msaa_render_phong(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
 	std::array<vec3, 3> world_coords, normals;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 	std::array<vec2, 3> uvs;
 
-	Light light;
-	light.position = vec3(3, 3, 0);
-	light.direction = vec3(-2, 2, 2);
-	light.ambient = 0.1 * vec3(255, 255, 255);
-	light.diffuse = vec3(255, 255, 255);
-	light.specular = vec3(255, 255, 255);
-
-	Material material;
-	material.ambient = material.diffuse = material.specular = vec3(249, 210, 228);
-	material.shininess = 32;
-
-	float* zbuffer = new float[HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
-	float** ssaa_zbuffer = new float* [HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) {
-		ssaa_zbuffer[i] = new float[4];
-		for (int j = 0; j < 4; j++) ssaa_zbuffer[i][j] = -std::numeric_limits<float>::max();
-	}
-	vec3** ssaa_framebuffer = new vec3 * [HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) {
-		ssaa_framebuffer[i] = new vec3[4];
-		for (int j = 0; j < 4; j++) ssaa_framebuffer[i][j] = vec3(0, 0, 0);
-	}
-
+	const Light& light = job.light;
+	const Material& material = job.material;
 
+	MultisampleBuffer msaa(job.width, job.height, job.samples);
 
 	PhoneLightShader shader;
-	for (int n = 1; n < argc; n++) {
-		Model model(argv[n]);
-		shader.projection = get_projection(EYE, CENTER);
-		shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		shader.lookat = get_lookat(EYE, CENTER, vec3(0, 1, 0));
-		shader.model = get_rotate(vec3(0, 1, 0), 45);
-		shader.eye = EYE;
+	shader.cull_face = job.cull;
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shader.uniforms.set_viewport(get_viewport(job));
+		shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shader.uniforms.set_model(get_model(job));
+		shader.eye = job.eye;
 		shader.material = material;
 		shader.light = light;
 
 
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+		vb.transform(*model, shader.uniforms.mvp());
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				normals[ivert] = model.normal(iface, ivert).normalize();
-				uvs[ivert] = model.uv(iface, ivert);
+				world_coords[ivert] = model->vert(iface, ivert);
+				normals[ivert] = model->normal(iface, ivert).normalize();
+				uvs[ivert] = model->uv(iface, ivert);
 			}
 			shader.normals = normals;
-			screen_coords = shader.vertex(world_coords);
-			//triangle(screen_coords, shader, zbuffer, image);
-			ssaa_triangle(screen_coords, shader, zbuffer, image, ssaa_zbuffer, ssaa_framebuffer);
+			screen_coords = shader.vertex(world_coords, vb.triangle(*model, iface));
+			draw(screen_coords, shader, msaa);
 		}
 	}
+	msaa.resolve(image);
+	std::cerr << "primitives: " << msaa.stats << std::endl;
 
-	image.write_tga_file("output.tga");
+	FrameWriter::global().submit(image, job.output);
 }
 
-void Bilinear_render_texture(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return;
-	}
-
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void Bilinear_render_texture(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
 	std::array<vec3, 3> world_coords;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 	std::array<vec2, 3> uvs;
 
-	float* zbuffer = new float[HEIGHT * WIDTH];
-	for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
+	float* zbuffer = fb.depth();
+	HierarchicalZ hiz(zbuffer, job.width, job.height);
 
 	BilinearTextureShader shader;
-	for (int n = 1; n < argc; n++) {
-		Model model(argv[n]);
-		shader.projection = get_projection(vec3(2, 0, 3), CENTER);
-		shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-		shader.lookat = get_lookat(vec3(2, 0, 3), CENTER, vec3(0, 1, 0));
-		shader.model = mat<4, 4>::identity();
-
-		for (int iface = 0; iface < model.nfaces(); iface++) {
+	shader.cull_face = job.cull;
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shader.uniforms.set_viewport(get_viewport(job));
+		shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shader.uniforms.set_model(get_model(job));
+		shader.texture = model->diffuse();
+
+		vb.transform(*model, shader.uniforms.mvp());
+		for (int iface = 0; iface < model->nfaces(); iface++) {
 			for (int ivert = 0; ivert < 3; ivert++) {
-				world_coords[ivert] = model.vert(iface, ivert);
-				uvs[ivert] = model.uv(iface, ivert);
+				world_coords[ivert] = model->vert(iface, ivert);
+				uvs[ivert] = model->uv(iface, ivert);
 			}
 			shader.uvs = uvs;
-			shader.texture = model.diffuse();
-			screen_coords = shader.vertex(world_coords);
-			triangle(screen_coords, shader, zbuffer, image);
+			screen_coords = shader.vertex(world_coords, vb.triangle(*model, iface));
+			draw(screen_coords, shader, hiz, image);
 		}
 	}
 
+	std::cerr << "hiz: " << hiz.stats << std::endl;
 	//image.flip_vertically();
-	image.write_tga_file("output.tga");
+	FrameWriter::global().submit(image, job.output);
 }
 
-void render_occlusion(int argc, char** argv) {
-	if (2 > argc) {
-		std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
-		return;
-	}
-
-	TGAImage image(WIDTH, HEIGHT, TGAImage::RGB);
+void Trilinear_render_texture(const RenderJob& job) {
+	Framebuffer fb(job.width, job.height);
+	TGAImage& image = fb.color();
+	AssetManager& assets = AssetManager::global();
 
-	std::array<vec3, 3> world_coords, normals;
+	std::array<vec3, 3> world_coords;
 	std::array<vec4, 3> screen_coords;
+	VertexBuffer vb;
 	std::array<vec2, 3> uvs;
 
-	DeepthShader deepth_shader;
-	OcclusionShader occlu_shader;
-	occlu_shader.occl.read_tga_file("occl.tga");
+	float* zbuffer = fb.depth();
+	HierarchicalZ hiz(zbuffer, job.width, job.height);
+
+	TrilinearTextureShader shader;
+	shader.cull_face = job.cull;
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		shader.uniforms.set_projection(get_projection(job.eye, job.center));
+		shader.uniforms.set_viewport(get_viewport(job));
+		shader.uniforms.set_lookat(get_lookat(job.eye, job.center, job.up));
+		shader.uniforms.set_model(get_model(job));
+		shader.texture = model->diffuse();
+
+		vb.transform(*model, shader.uniforms.mvp());
+		for (int iface = 0; iface < model->nfaces(); iface++) {
+			for (int ivert = 0; ivert < 3; ivert++) {
+				world_coords[ivert] = model->vert(iface, ivert);
+				uvs[ivert] = model->uv(iface, ivert);
+			}
+			shader.uvs = uvs;
+			screen_coords = shader.vertex(world_coords, vb.triangle(*model, iface));
+			draw(screen_coords, shader, hiz, image);
+		}
+	}
 
-	const int nrenders = 30;
+	std::cerr << "hiz: " << hiz.stats << std::endl;
+	//image.flip_vertically();
+	FrameWriter::global().submit(image, job.output);
+}
+
+//iterεĹշֻ(job.sampler,job.seed,iter),ִ߳˳޹.
+//upֻӰͼƹշתĽǶ,ÿתһøε
+static void occlusion_direction(const RenderJob& job, int iter, vec3& eye, vec3& up) {
+	std::seed_seq seq{ job.seed, (unsigned)iter };
+	std::mt19937 rng(seq);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	for (int i = 0; i < 3; i++) up[i] = uniform(rng);
+	eye = uniform_hemisphere(sample_2d(job.sampler, iter - 1, job.iterations, job.seed));
+}
+
+//ÿֵĵ,tolerance>0ʱÿֽһ.̶,ͣһֲ߳޹
+constexpr int OCCLUSION_ROUND = 8;
+
+//֮以:ÿλԼͼ,Ӱͼ,ɫͼͼ,ӹ,
+//ÿֽλ˳ProgressiveMean,߳޹.
+//job.tolerance>0ʱƵǰ,job.iterations.
+//job.texture_spaceʱڶ鲻ٴĻռƬԪuvдͼ(©дظдͶӰ),
+//ǶTexelMapÿйֱӲӰͼ,ذп鲢,д
+void render_occlusion(const RenderJob& job) {
+	AssetManager& assets = AssetManager::global();
+	ThreadPool& pool = ThreadPool::global();
+	const int nrenders = job.iterations;
+	const int round = job.tolerance > 0 ? OCCLUSION_ROUND : nrenders;
+
+	//һεoccl.tgaܻд̵߳Ķ
+	FrameWriter::global().flush();
+	TGAImage occl_map;
+	occl_map.read_tga_file(job.occlusion_map);
+
+	//ռ決ʱͼͼһ,ͼûС;ĻռûС
+	const bool texture_space = job.texture_space;
+	const int tw = texture_space && occl_map.width() ? occl_map.width() : job.width;
+	const int th = texture_space && occl_map.height() ? occl_map.height() : job.height;
+	const int npixels = tw * th;
+	const mat<4, 4> normal_mat = get_model(job).invert_transpose();
+	TexelMap texels(texture_space ? tw : 0, texture_space ? th : 0);
+	if (texture_space) {
+		//ģͿռ佨ͼ,light_spaceѾmodel
+		for (const std::string& file : job.models) texels.add(*assets.model(file), mat<4, 4>::identity());
+		texels.build(pool);
+		std::cerr << "texel map: " << texels.stats() << std::endl;
+	}
+
+	std::vector<vec3> eyes(nrenders + 1), ups(nrenders + 1);
 	for (int iter = 1; iter <= nrenders; iter++) {
-		vec3 eye, up;
-		std::cerr << iter << " from " << nrenders << std::endl;
-		for (int i = 0; i < 3; i++) up[i] = (float)rand() / (float)RAND_MAX;
-		eye = rand_point_on_unit_sphere();
-		eye.y = std::abs(eye.y);
-		std::cout << "v " << eye << std::endl;
-
-		float* zbuffer = new float[HEIGHT * WIDTH], * shadow_buffer = new float[HEIGHT * WIDTH];
-		for (int i = 0; i < HEIGHT * WIDTH; i++) zbuffer[i] = -std::numeric_limits<float>::max();
-		for (int i = 0; i < HEIGHT * WIDTH; i++) shadow_buffer[i] = -std::numeric_limits<float>::max();
-
-
-		for (int n = 1; n < argc-1; n++) {
-			//Model model(R"(D:\code\MyTinyRenderer\obj\spot_triangulated_good.obj)");
-			Model model(argv[n]);
-			deepth_shader.projection = mat<4, 4>::identity();
-			deepth_shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-			deepth_shader.lookat = get_lookat(eye, CENTER, up);
-			deepth_shader.model = mat<4, 4>::identity();
-
-			for (int iface = 0; iface < model.nfaces(); iface++) {
-				for (int ivert = 0; ivert < 3; ivert++) {
-					world_coords[ivert] = model.vert(iface, ivert);
+		occlusion_direction(job, iter, eyes[iter], ups[iter]);
+		std::cout << "v " << eyes[iter] << std::endl;
+	}
+
+	const int nslots = std::min<int>(pool.size(), round);
+	//visible[2*slot+p]:òλżΪpĵļ֮,nvisibleǶӦĵ
+	std::vector<std::vector<int>> visible(2 * nslots, std::vector<int>(npixels, 0));
+	std::vector<int> nvisible(2 * nslots, 0);
+	std::vector<CullStats> depth_stats(nslots), occl_stats(nslots);
+	ProgressiveMean accum(npixels);
+	TGAImage last_occl;
+	int iterations = 0;
+	double error = 0;
+	std::atomic<int> done{ 0 };
+	std::mutex log_mtx;
+	while (iterations < nrenders) {
+		const int first = iterations + 1, last = std::min(nrenders, iterations + round);
+		std::atomic<int> next{ first };
+		pool.parallel_for(nslots, [&](int slot) {
+			Framebuffer fb(job.width, job.height);
+			TGAImage& image = fb.color();
+			float* zbuffer = fb.depth(), * shadow_buffer = fb.attachment("shadow");
+
+			std::array<vec3, 3> world_coords;
+			std::array<vec4, 3> screen_coords;
+			std::array<vec2, 3> uvs;
+			VertexBuffer vb;
+			DeepthShader deepth_shader;
+			OcclusionShader occlu_shader;
+			deepth_shader.cull_face = occlu_shader.cull_face = job.cull;
+			occlu_shader.occl = occl_map;
+			TileRasterizer<DeepthShader> deepth_raster(job.width, job.height);
+
+			for (int iter; (iter = next++) <= last;) {
+				const vec3 eye = eyes[iter], up = ups[iter];
+				fb.clear_depth();
+				fb.clear_attachments();
+				HierarchicalZ hiz(zbuffer, job.width, job.height);
+
+				for (const std::string& file : job.models) {
+					std::shared_ptr<const Model> model = assets.model(file);
+					deepth_shader.uniforms.set_projection(mat<4, 4>::identity());
+					deepth_shader.uniforms.set_viewport(get_viewport(job));
+					deepth_shader.uniforms.set_lookat(get_lookat(eye, job.center, up));
+					deepth_shader.uniforms.set_model(get_model(job));
+
+					vb.transform(*model, deepth_shader.uniforms.mvp());
+					deepth_raster.bind(deepth_shader);
+					for (int iface = 0; iface < model->nfaces(); iface++) {
+						for (int ivert = 0; ivert < 3; ivert++) {
+							world_coords[ivert] = model->vert(iface, ivert);
+						}
+						screen_coords = deepth_shader.vertex(world_coords, vb.triangle(*model, iface));
+						deepth_raster.triangle(screen_coords, deepth_shader);
+					}
+				}
+				deepth_raster.flush(shadow_buffer, image);
+
+				std::vector<int>& count = visible[2 * slot + (iter & 1)];
+				nvisible[2 * slot + (iter & 1)]++;
+				if (texture_space) {
+					occlu_shader.uniforms.set_light_space(deepth_shader.uniforms.mvp());
+					occlu_shader.shadow_buffer = shadow_buffer;
+					occlu_shader.dim = vec2(job.width, job.height);
+					//occl.tgaһεĿɼͼ,ֻ쵽lastĲλд
+					if (iter == last) last_occl = TGAImage(tw, th, TGAImage::RGB);
+					pool.parallel_for((th + TexelMap::TILE - 1) / TexelMap::TILE, [&](int band) {
+						for (int y = band * TexelMap::TILE; y < std::min(th, (band + 1) * TexelMap::TILE); y++) {
+							for (int x = 0; x < tw; x++) {
+								const int k = x + y * tw;
+								const TexelMap::Texel& texel = texels[k];
+								if (texel.face < 0) continue;
+								//ͼͶӰ,߷򴦴eye-center;޳һ治㱻յ
+								const vec3 n = proj<3>(normal_mat * embed<4>(texel.n, 0.f));
+								const float cosine = n * (eye - job.center);
+								const float facing = job.cull == CullFace::Front ? -cosine : job.cull == CullFace::None ? std::abs(cosine) : cosine;
+								if (facing <= 0 || !occlu_shader.lit(texel.p)) continue;
+								count[k] += 255;
+								if (iter == last) last_occl.set(x, y, TGAColor(255, 255, 255, 255));
+							}
+						}
+					});
 				}
-				screen_coords = deepth_shader.vertex(world_coords);
-				triangle(screen_coords, deepth_shader, shadow_buffer, image);
+				else {
+					occlu_shader.occl.clear();
+					for (const std::string& file : job.models) {
+						std::shared_ptr<const Model> model = assets.model(file);
+						occlu_shader.uniforms.set_projection(get_projection(eye, job.center));
+						occlu_shader.uniforms.set_viewport(get_viewport(job));
+						occlu_shader.uniforms.set_lookat(get_lookat(eye, job.center, up));
+						occlu_shader.uniforms.set_model(get_model(job));
+						occlu_shader.uniforms.set_light_space(deepth_shader.uniforms.mvp());
+						occlu_shader.shadow_buffer = shadow_buffer;
+						occlu_shader.dim = vec2(job.width, job.height);
+
+						vb.transform(*model, occlu_shader.uniforms.mvp());
+						for (int iface = 0; iface < model->nfaces(); iface++) {
+							for (int ivert = 0; ivert < 3; ivert++) {
+								world_coords[ivert] = model->vert(iface, ivert);
+								uvs[ivert] = model->uv(iface, ivert);
+							}
+							occlu_shader.uvs = uvs;
+							screen_coords = occlu_shader.vertex(world_coords, vb.triangle(*model, iface));
+							draw(screen_coords, occlu_shader, hiz, image);
+						}
+					}
+
+					for (int j = 0; j < job.height; j++)
+						for (int i = 0; i < job.width; i++) count[i + j * job.width] += occlu_shader.occl.get(i, j)[0];
+					occl_stats[slot] += hiz.stats;
+					//occl.tgaһεĿɼͼ
+					if (iter == last) last_occl = occlu_shader.occl;
+				}
+
+				std::lock_guard<std::mutex> lock(log_mtx);
+				std::cerr << ++done << " from " << nrenders << std::endl;
 			}
+			depth_stats[slot] += deepth_raster.stats();
+		});
+
+		for (int k = 0; k < 2 * nslots; k++) {
+			if (!nvisible[k]) continue;
+			accum.add(k, visible[k], nvisible[k]);
+			std::fill(visible[k].begin(), visible[k].end(), 0);
+			nvisible[k] = 0;
 		}
+		iterations = last;
+		error = accum.error();
+		if (job.tolerance > 0 && error < job.tolerance) break;
+	}
 
-		occlu_shader.occl.clear();
-		for (int n = 1; n < argc-1; n++) {
-			Model model(argv[n]);
-			occlu_shader.projection = get_projection(eye, CENTER);
-			occlu_shader.viewport = get_viewport(WIDTH / 8, HEIGHT / 8, WIDTH * 3 / 4, HEIGHT * 3 / 4);
-			occlu_shader.lookat = get_lookat(eye, CENTER, up);
-			occlu_shader.model = mat<4, 4>::identity();
-			occlu_shader.deepth_matrix = deepth_shader.viewport * deepth_shader.projection * deepth_shader.lookat * deepth_shader.model;
-			occlu_shader.shadow_buffer = shadow_buffer;
-			occlu_shader.dim = vec2(WIDTH, HEIGHT);
-
-			for (int iface = 0; iface < model.nfaces(); iface++) {
-				for (int ivert = 0; ivert < 3; ivert++) {
-					world_coords[ivert] = model.vert(iface, ivert);
-					uvs[ivert] = model.uv(iface, ivert);
-				}
-				occlu_shader.uvs = uvs;
-				screen_coords = occlu_shader.vertex(world_coords);
-				triangle(screen_coords, occlu_shader, zbuffer, image);
-			}
+	CullStats depth_total, occl_total;
+	for (int slot = 0; slot < nslots; slot++) {
+		depth_total += depth_stats[slot];
+		occl_total += occl_stats[slot];
+	}
+	std::cerr << "depth pass: " << depth_total << std::endl;
+	if (!texture_space) std::cerr << "occlusion pass: " << occl_total << std::endl;
+	std::cerr << sequence_name(job.sampler) << ": " << iterations << " of " << nrenders << " iterations, error " << error << std::endl;
+
+	TGAImage image(tw, th, TGAImage::RGB);
+	for (int j = 0; j < th; j++) {
+		for (int i = 0; i < tw; i++) {
+			const int factor = accum.mean(i + j * tw);
+			image.set(i, j, TGAColor(factor, factor, factor, 255));
 		}
+	}
+	//image.flip_vertically();
+	FrameWriter::global().submit(std::move(image), job.output);
+	FrameWriter::global().submit(std::move(last_occl), job.occlusion_map);
+}
 
-		for (int i = 0; i < WIDTH; i++) {
-			for (int j = 0; j < HEIGHT; j++) {
-				float tmp = image.get(i, j)[0];
-				float factor = (tmp * (iter - 1) + occlu_shader.occl.get(i, j)[0]) / (float)iter + .5f;
-				image.set(i, j, TGAColor(factor,factor,factor,255));
+//׷ٰocclusion:TexelMap϶Ӧĵy>=0job.rays,
+//صֵǴЩܿ(ûס)ı,render_occlusiontotal_occlͬ,
+//ûӰͼķֱʺƫ.ðشҵSobol,߳޹
+void render_occlusion_rt(const RenderJob& job) {
+	AssetManager& assets = AssetManager::global();
+	//дocclusion_map,render_occlusionһĴС決,ûС
+	FrameWriter::global().flush();
+	TGAImage occl_map;
+	occl_map.read_tga_file(job.occlusion_map);
+	const int tw = occl_map.width() ? occl_map.width() : job.width;
+	const int th = occl_map.height() ? occl_map.height() : job.height;
+	const int npixels = tw * th;
+	const mat<4, 4> model_mat = get_model(job);
+
+	//ÿعϵĵͼη,ռ,BVHһ
+	TexelMap texels(tw, th);
+	BVH bvh;
+	for (const std::string& file : job.models) {
+		std::shared_ptr<const Model> model = assets.model(file);
+		bvh.add(*model, model_mat);
+		texels.add(*model, model_mat);
+	}
+	texels.build();
+	std::cerr << "texel map: " << texels.stats() << std::endl;
+	bvh.build();
+	std::cerr << "bvh: " << bvh.stats() << std::endl;
+
+	//طŲһ,ôԼڵ
+	const float eps = 1e-4f * bvh.diagonal();
+	const int nrays = job.rays;
+	std::vector<int> value(npixels, 0);
+	std::atomic<long long> traced{ 0 };
+	std::atomic<int> baked{ 0 };
+	const auto t0 = std::chrono::steady_clock::now();
+	ThreadPool::global().parallel_for(th, [&](int y) {
+		long long rays = 0;
+		int count = 0;
+		for (int x = 0; x < tw; x++) {
+			const int k = x + y * tw;
+			const TexelMap::Texel& texel = texels[k];
+			if (texel.face < 0) continue;
+			const std::uint32_t sx = hash_bits(job.seed, k), sy = hash_bits(sx, k);
+			int visible = 0;
+			for (int s = 0; s < nrays; s++) {
+				const vec3 d = uniform_hemisphere(sobol(s, sx, sy));
+				const float cosine = d * texel.n;
+				//դһ,޳һ治㱻յ
+				const float facing = job.cull == CullFace::Front ? -cosine : job.cull == CullFace::None ? std::abs(cosine) : cosine;
+				if (facing <= 0) continue;
+				Ray ray;
+				ray.origin = texel.p + texel.n * (cosine > 0 ? eps : -eps);
+				ray.dir = d;
+				rays++;
+				if (!bvh.occluded(ray)) visible++;
 			}
+			value[k] = (visible * 255 + nrays / 2) / nrays;
+			count++;
+		}
+		traced += rays;
+		baked += count;
+	});
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	std::cerr << "occlusion_rt: " << baked << " texels, " << traced << " rays in " << ms << " ms ("
+		<< traced / ms / 1000 << " Mrays/s)" << std::endl;
+
+	TGAImage image(tw, th, TGAImage::RGB);
+	for (int j = 0; j < th; j++) {
+		for (int i = 0; i < tw; i++) {
+			const int factor = value[i + j * tw];
+			image.set(i, j, TGAColor(factor, factor, factor, 255));
 		}
-
-		delete[] zbuffer;
-		delete[] shadow_buffer;
 	}
+	FrameWriter::global().submit(image, job.occlusion_map);
+	FrameWriter::global().submit(std::move(image), job.output);
+}
 
-	//image.flip_vertically();
-	image.write_tga_file("total_occl.tga");
-	occlu_shader.occl.write_tga_file("occl.tga");
+void render(const RenderJob& job) {
+	if (job.mode == "shadow") render_shadow(job);
+	else if (job.mode == "texture") render_texture(job);
+	else if (job.mode == "phong") render_phong(job);
+	else if (job.mode == "normal") render_normal(job);
+	else if (job.mode == "msaa") msaa_render_phong(job);
+	else if (job.mode == "bilinear") Bilinear_render_texture(job);
+	else if (job.mode == "trilinear") Trilinear_render_texture(job);
+	else if (job.mode == "occlusion") render_occlusion(job);
+	else if (job.mode == "occlusion_rt") render_occlusion_rt(job);
+	else std::cerr << "unknown render mode " << job.mode << std::endl;
+}
+
+//һ:ģͺȫһ,ֻֻ֮Դ,
+//̳ͨ߳ϲ,occlusionҪԼϴдͼ,occlusion_rtдͼ,
+//߰˳ڵ߳,ڲ̳߳
+void render_batch(const std::vector<RenderJob>& jobs) {
+	AssetManager& assets = AssetManager::global();
+	assets.begin_frame();
+	const auto t0 = std::chrono::steady_clock::now();
+	std::vector<std::shared_ptr<const Model>> resident;
+	for (const RenderJob& job : jobs)
+		for (const std::string& file : job.models) resident.push_back(assets.model(file));
+
+	std::vector<int> parallel, serial;
+	for (int i = 0; i < (int)jobs.size(); i++) (jobs[i].mode == "occlusion" || jobs[i].mode == "occlusion_rt" ? serial : parallel).push_back(i);
+	//ڲķֿդͬһ̳߳Ƕparallel_for;Ƕ׵ĵֻԼһֿ,
+	//ڵȴʱܱ,Ƕȹ̶Ϊ2
+	ThreadPool::global().parallel_for((int)parallel.size(), [&](int i) { render(jobs[parallel[i]]); });
+	for (int i : serial) render(jobs[i]);
+	FrameWriter::global().flush();
+
+	const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	std::cerr << jobs.size() << " jobs in " << ms << " ms (" << jobs.size() * 1000. / ms << " views/s)" << std::endl;
+	std::cerr << "assets: " << assets.frame_stats() << std::endl;
 }
 
+//÷: renderer scene.txt                    ļȾ
+//      renderer <mode> obj/model.obj...      øģʽĬȾһ
 int main(int argc, char** argv) {
-	render_occlusion(argc, argv);
+	std::vector<RenderJob> jobs;
+	if (argc >= 3 && RenderJob::known_mode(argv[1])) {
+		jobs.push_back(RenderJob::defaults(argv[1]));
+		jobs.back().models.assign(argv + 2, argv + argc);
+	}
+	else if (argc == 2) {
+		if (!load_scene(argv[1], jobs)) return 1;
+	}
+	else {
+		std::cerr << "Usage: " << argv[0] << " scene.txt" << std::endl;
+		std::cerr << "       " << argv[0] << " shadow|texture|phong|normal|msaa|bilinear|trilinear|occlusion|occlusion_rt obj/model.obj..." << std::endl;
+		return 1;
+	}
+	render_batch(jobs);
+	std::cerr << "writer: " << FrameWriter::global().stats() << std::endl;
 	return 0;
-}
\ No newline at end of file
+}
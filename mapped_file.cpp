@@ -0,0 +1,84 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename) {
+	HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f == INVALID_HANDLE_VALUE) return;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+		CloseHandle(f);
+		return;
+	}
+	HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m) {
+		CloseHandle(f);
+		return;
+	}
+	void* view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(m);
+		CloseHandle(f);
+		return;
+	}
+	file = f, mapping = m;
+	ptr = (const char*)view;
+	len = (size_t)size.QuadPart;
+}
+
+MappedFile::~MappedFile() {
+	if (ptr) UnmapViewOfFile(ptr);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+}
+
+uint64_t file_size(const std::string& filename) {
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attr)) return 0;
+	return ((uint64_t)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+}
+#else
+MappedFile::MappedFile(const std::string& filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return;
+	}
+	void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	//ӳ佨ļԹر
+	close(fd);
+	if (view == MAP_FAILED) return;
+	ptr = (const char*)view;
+	len = (size_t)st.st_size;
+}
+
+MappedFile::~MappedFile() {
+	if (ptr) munmap((void*)ptr, len);
+}
+
+uint64_t file_size(const std::string& filename) {
+	struct stat st;
+	return stat(filename.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+}
+#endif
+
+uint64_t fnv1a64(const char* data, size_t size) {
+	uint64_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+//ֻڴӳļ,ӳʧ(ļڻΪ)ʱis_open()Ϊfalse
+class MappedFile {
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool is_open() const { return ptr != nullptr; }
+	const char* data() const { return ptr; }
+	size_t size() const { return len; }
+
+private:
+	const char* ptr = nullptr;
+	size_t len = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
+
+//ļС,ʱΪ0
+uint64_t file_size(const std::string& filename);
+
+//FNV-1a 64λϣ
+uint64_t fnv1a64(const char* data, size_t size);
+
+#endif // !MAPPED_FILE_H
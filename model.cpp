@@ -1,88 +1,521 @@
 #include <iostream>
-#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include "model.h"
+#include "thread_pool.h"
 
-Model::Model(const std::string filename) {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            vec3 v;
-            for (int i=0;i<3;i++) iss >> v[i];
-            verts.push_back(v);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            vec3 n;
-            for (int i=0;i<3;i++) iss >> n[i];
-            norms.push_back(n.normalize());
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            vec2 uv;
-            for (int i=0;i<2;i++) iss >> uv[i];
-            tex_coord.push_back({uv.x, 1-uv.y});
-        }  else if (!line.compare(0, 2, "f ")) {
-            int f,t,n;
-            iss >> trash;
-            int cnt = 0;
-            while (iss >> f >> trash >> t >> trash >> n) {
-                facet_vrt.push_back(--f);
-                facet_tex.push_back(--t);
-                facet_nrm.push_back(--n);
-                cnt++;
+static const char MESH_MAGIC[4] = {'T', 'R', 'M', 'C'};
+static const uint32_t MESH_VERSION = 3;
+
+static size_t mesh_size(const MeshHeader &h) {
+    return sizeof(MeshHeader) + sizeof(float)*8*size_t(h.nverts) + sizeof(uint32_t)*size_t(h.nindices);
+}
+
+static std::string mesh_filename(const std::string filename) {
+    size_t dot = filename.find_last_of(".");
+    return (dot==std::string::npos ? filename : filename.substr(0,dot)) + ".mesh";
+}
+
+Model::Model(const std::string filename, const bool use_cache, const TextureLoader &loader) {
+    MappedFile source(filename);
+    if (!source.is_open()) return;
+    bytes_read += source.size();
+    const uint64_t source_hash = use_cache ? fnv1a64(source.data(), source.size()) : 0;
+    const std::string meshfile = mesh_filename(filename);
+    if (!(use_cache && open_mesh(meshfile, source_hash))) {
+        if (!parse_obj(source.data(), source.size(), source_hash)) return;
+        if (use_cache && !write_mesh(meshfile))
+            std::cerr << "mesh cache " << meshfile << " could not be written" << std::endl;
+    }
+    std::cerr << "# v# " << nverts() << " f# "  << nfaces() << (from_cache() ? " (mesh cache)" : "") << std::endl;
+    if (cache) bytes_read += cache->size();
+    diffusemap  = load_texture(filename, "_diffuse.tga",    loader);
+    normalmap   = load_texture(filename, "_nm_tangent.tga", loader);
+    specularmap = load_texture(filename, "_spec.tga",       loader);
+}
+
+namespace {
+    // Everything one line-aligned slice of the OBJ text defines. Chunks are parsed independently
+    // and merged in file order, so counts are only known relative to the chunk start until then.
+    struct ObjChunk {
+        std::vector<float> v, vt, vn;  // 3, 2 and 3 floats per element
+        std::vector<int> corners;      // v,t,n per triangle corner, 0-based, -1 when the face omits it
+        std::vector<size_t> relative;  // corners given as negative (relative) references, counted from the chunk start
+        int malformed = 0;             // lines skipped
+        int missing_normals = 0;       // triangles that get a flat normal at merge time
+        bool missing_uv = false;
+    };
+
+    // zero-length normals (vn 0 0 0, degenerate faces) would normalize to NaN; point them along +z instead
+    vec3 unit_normal(vec3 n) {
+        return n.norm2()>0 ? n.normalize() : vec3(0, 0, 1);
+    }
+
+    const char *skip_space(const char *p, const char *end) {
+        while (p<end && (*p==' ' || *p=='\t' || *p=='\r')) p++;
+        return p;
+    }
+
+    template <typename T> const char *parse_number(const char *p, const char *end, T &out, bool &ok) {
+        p = skip_space(p, end);
+        if (p<end && *p=='+') p++; // from_chars does not accept a leading plus
+        std::from_chars_result r = std::from_chars(p, end, out);
+        if (r.ec!=std::errc()) ok = false;
+        return r.ptr;
+    }
+
+    void parse_chunk(const char *p, const char *end, ObjChunk &c) {
+        std::vector<int> poly;      // v,t,n of each corner of the current face
+        std::vector<char> poly_rel; // which of them are relative
+        while (p<end) {
+            const char *eol = static_cast<const char*>(std::memchr(p, '\n', end-p));
+            if (!eol) eol = end;
+            // a '#' starts a comment anywhere on the line; data stops there
+            const char *hash = static_cast<const char*>(std::memchr(p, '#', eol-p));
+            const char *stop = hash ? hash : eol;
+            p = skip_space(p, stop);
+            const char *key = p;
+            while (p<stop && *p!=' ' && *p!='\t' && *p!='\r') p++;
+            const size_t keylen = p-key;
+            bool ok = true;
+            if (keylen==1 && key[0]=='v') {
+                float x=0, y=0, z=0;
+                p = parse_number(p, stop, x, ok);
+                p = parse_number(p, stop, y, ok);
+                p = parse_number(p, stop, z, ok);
+                if (ok) c.v.insert(c.v.end(), {x, y, z});
+            } else if (keylen==2 && key[0]=='v' && key[1]=='t') {
+                float u=0, v=0;
+                p = parse_number(p, stop, u, ok);
+                if (skip_space(p, stop)<stop) p = parse_number(p, stop, v, ok);
+                if (ok) c.vt.insert(c.vt.end(), {u, 1-v});
+            } else if (keylen==2 && key[0]=='v' && key[1]=='n') {
+                vec3 n;
+                for (int i=0; i<3; i++) p = parse_number(p, stop, n[i], ok);
+                n = unit_normal(n);
+                if (ok) c.vn.insert(c.vn.end(), {n.x, n.y, n.z});
+            } else if (keylen==1 && key[0]=='f') {
+                poly.clear();
+                poly_rel.clear();
+                const int count[3] = {int(c.v.size()/3), int(c.vt.size()/2), int(c.vn.size()/3)};
+                while (ok && (p = skip_space(p, stop))<stop) {
+                    // v, v/t, v//n or v/t/n
+                    int idx[3] = {0, 0, 0};
+                    p = parse_number(p, stop, idx[0], ok);
+                    if (p<stop && *p=='/') {
+                        p++;
+                        if (p<stop && *p!='/') p = parse_number(p, stop, idx[1], ok);
+                        if (p<stop && *p=='/') p = parse_number(p+1, stop, idx[2], ok);
+                    }
+                    if (!idx[0]) ok = false;
+                    for (int k=0; k<3; k++) {
+                        poly.push_back(idx[k]>0 ? idx[k]-1 : idx[k]<0 ? count[k]+idx[k] : -1);
+                        poly_rel.push_back(idx[k]<0);
+                    }
+                }
+                const int n = poly.size()/3;
+                if (n<3) ok = false;
+                // triangulate polygons as a fan around the first corner
+                for (int k=1; ok && k+1<n; k++) {
+                    const int fan[3] = {0, k, k+1};
+                    bool no_normal = false;
+                    for (int corner : fan) {
+                        for (int i=0; i<3; i++) {
+                            if (poly_rel[corner*3+i]) c.relative.push_back(c.corners.size());
+                            c.corners.push_back(poly[corner*3+i]);
+                        }
+                        c.missing_uv |= poly[corner*3+1]<0 && !poly_rel[corner*3+1];
+                        no_normal |= poly[corner*3+2]<0 && !poly_rel[corner*3+2];
+                    }
+                    c.missing_normals += no_normal;
+                }
             }
-            if (3!=cnt) {
-                std::cerr << "Error: the obj file is supposed to be triangulated" << std::endl;
-                in.close();
-                return;
+            if (!ok) c.malformed++;
+            p = eol+1;
+        }
+    }
+}
+
+bool Model::parse_obj(const char *text, const size_t size, const uint64_t source_hash) {
+    const auto start = std::chrono::steady_clock::now();
+    ThreadPool &pool = ThreadPool::global();
+    // line-aligned chunks of at least 1MB, a few per thread for load balance
+    const int nchunks = std::max(1, int(std::min<size_t>(pool.size()*4, size>>20)));
+    std::vector<const char*> bounds(nchunks+1, text+size);
+    bounds[0] = text;
+    for (int i=1; i<nchunks; i++) {
+        const char *p = std::max(bounds[i-1], text + size*i/nchunks);
+        const char *eol = p>text ? static_cast<const char*>(std::memchr(p-1, '\n', text+size-(p-1))) : p-1;
+        bounds[i] = eol ? eol+1 : text+size;
+    }
+    std::vector<ObjChunk> chunks(nchunks);
+    pool.parallel_for(nchunks, [&](int i) { parse_chunk(bounds[i], bounds[i+1], chunks[i]); });
+
+    // element offsets of each chunk in file order
+    std::vector<int> base_v(nchunks+1, 0), base_vt(nchunks+1, 0), base_vn(nchunks+1, 0);
+    for (int i=0; i<nchunks; i++) {
+        base_v[i+1]  = base_v[i]  + chunks[i].v.size()/3;
+        base_vt[i+1] = base_vt[i] + chunks[i].vt.size()/2;
+        base_vn[i+1] = base_vn[i] + chunks[i].vn.size()/3;
+    }
+    const int nv = base_v[nchunks], nvt = base_vt[nchunks], nvn = base_vn[nchunks];
+    // resolve relative references and drop triangles that point outside the arrays
+    pool.parallel_for(nchunks, [&](int i) {
+        ObjChunk &c = chunks[i];
+        const int base[3] = {base_v[i], base_vt[i], base_vn[i]}, total[3] = {nv, nvt, nvn};
+        for (size_t pos : c.relative) c.corners[pos] += base[pos%3];
+        size_t out = 0;
+        for (size_t tri=0; tri<c.corners.size(); tri+=9) {
+            bool valid = true;
+            for (int k=0; k<9; k++) {
+                const int idx = c.corners[tri+k];
+                // -1 means absent, relative references that fell before the file start are invalid
+                valid &= idx<total[k%3] && (idx>=0 || (idx==-1 && k%3 && !std::binary_search(c.relative.begin(), c.relative.end(), tri+k)));
+            }
+            if (!valid) {
+                c.malformed++;
+                continue;
             }
+            std::copy(c.corners.begin()+tri, c.corners.begin()+tri+9, c.corners.begin()+out);
+            out += 9;
         }
+        c.corners.resize(out);
+        c.missing_normals = 0;
+        for (size_t tri=0; tri<out; tri+=9)
+            c.missing_normals += c.corners[tri+2]<0 || c.corners[tri+5]<0 || c.corners[tri+8]<0;
+    });
+
+    std::vector<int> base_tri(nchunks+1, 0), base_flat(nchunks+1, 0);
+    bool missing_uv = false;
+    int malformed = 0;
+    for (int i=0; i<nchunks; i++) {
+        base_tri[i+1] = base_tri[i] + chunks[i].corners.size()/9;
+        base_flat[i+1] = base_flat[i] + chunks[i].missing_normals;
+        missing_uv |= chunks[i].missing_uv;
+        malformed += chunks[i].malformed;
     }
-    in.close();
-    std::cerr << "# v# " << nverts() << " f# "  << nfaces() << " vt# " << tex_coord.size() << " vn# " << norms.size() << std::endl;
-    load_texture(filename, "_diffuse.tga",    diffusemap );
-    load_texture(filename, "_nm_tangent.tga", normalmap  );
-    load_texture(filename, "_spec.tga",       specularmap);
+    if (malformed) std::cerr << "Warning: " << malformed << " malformed obj lines or faces skipped" << std::endl;
+
+    // absent uvs share one (0,0) entry after the parsed ones, absent normals get a flat normal each
+    const int ntri = base_tri[nchunks];
+    std::vector<float> positions(nv*3), uvs((nvt + missing_uv)*2, 0.f), normals((nvn + base_flat[nchunks])*3);
+    std::vector<int> corners(size_t(ntri)*9);
+    pool.parallel_for(nchunks, [&](int i) {
+        const ObjChunk &c = chunks[i];
+        std::copy(c.v.begin(), c.v.end(), positions.begin() + base_v[i]*3);
+        std::copy(c.vt.begin(), c.vt.end(), uvs.begin() + base_vt[i]*2);
+        std::copy(c.vn.begin(), c.vn.end(), normals.begin() + base_vn[i]*3);
+    });
+    pool.parallel_for(nchunks, [&](int i) {
+        const ObjChunk &c = chunks[i];
+        int flat = nvn + base_flat[i];
+        for (size_t tri=0; tri<c.corners.size()/9; tri++) {
+            const int *corner = &c.corners[tri*9];
+            int *out = &corners[(base_tri[i]+tri)*9];
+            int normal = -1;
+            if (corner[2]<0 || corner[5]<0 || corner[8]<0) {
+                normal = flat++;
+                vec3 p[3];
+                for (int k=0; k<3; k++) p[k] = vec3(positions[corner[k*3]*3], positions[corner[k*3]*3+1], positions[corner[k*3]*3+2]);
+                const vec3 n = unit_normal(cross(p[1]-p[0], p[2]-p[0]));
+                for (int k=0; k<3; k++) normals[normal*3+k] = n[k];
+            }
+            for (int k=0; k<3; k++) {
+                out[k*3]   = corner[k*3];
+                out[k*3+1] = corner[k*3+1]<0 ? nvt : corner[k*3+1];
+                out[k*3+2] = corner[k*3+2]<0 ? normal : corner[k*3+2];
+            }
+        }
+    });
+    chunks.clear();
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    const double mb = size/1048576.;
+    std::cerr << "obj " << mb << " MB parsed in " << ms << " ms (" << mb/(ms/1000.) << " MB/s, " << nchunks << " chunks)" << std::endl;
+
+    build_mesh(positions, uvs, normals, corners, source_hash);
+    return true;
+}
+
+namespace {
+    // Open addressing table from a vertex's 8 attribute floats to its welded index
+    class WeldTable {
+        std::vector<uint32_t> slots;
+        uint32_t mask;
+        std::vector<float> &verts; // 8 floats per welded vertex
+        static uint64_t hash(const uint32_t *w) {
+            uint64_t h = 0x9e3779b97f4a7c15ull;
+            for (int i=0; i<8; i++) {
+                h ^= w[i];
+                h *= 0xff51afd7ed558ccdull;
+                h ^= h>>32;
+            }
+            return h;
+        }
+    public:
+        WeldTable(const size_t expected, std::vector<float> &verts) : verts(verts) {
+            size_t cap = 16;
+            while (cap < expected*2) cap *= 2;
+            slots.assign(cap, ~0u);
+            mask = cap-1;
+        }
+        uint32_t insert(const float attr[8]) {
+            uint32_t w[8];
+            std::memcpy(w, attr, sizeof(w));
+            for (uint32_t i = hash(w)&mask;; i = (i+1)&mask) {
+                if (slots[i]==~0u) {
+                    slots[i] = verts.size()/8;
+                    verts.insert(verts.end(), attr, attr+8);
+                    return slots[i];
+                }
+                if (!std::memcmp(&verts[size_t(slots[i])*8], attr, sizeof(w))) return slots[i];
+            }
+        }
+    };
+
+    // Hit rate of a simulated LRU post-transform cache over an index buffer
+    double cache_hit_rate(const std::vector<uint32_t> &idx, const int cache_size) {
+        std::vector<uint32_t> cache;
+        size_t hits = 0;
+        for (uint32_t v : idx) {
+            auto it = std::find(cache.begin(), cache.end(), v);
+            if (it!=cache.end()) {
+                hits++;
+                cache.erase(it);
+            } else if ((int)cache.size()==cache_size) {
+                cache.pop_back();
+            }
+            cache.insert(cache.begin(), v);
+        }
+        return idx.empty() ? 0. : double(hits)/idx.size();
+    }
+
+    // Tom Forsyth's linear-speed vertex cache optimisation: greedily emits the triangle whose
+    // vertices score best, favouring vertices already in a modelled LRU cache and vertices
+    // with few remaining triangles, so that meshes are finished off locally
+    const int FORSYTH_CACHE = 32;
+
+    float forsyth_score(const int cache_pos, const int remaining) {
+        if (!remaining) return -1.f;
+        float score = 0.f;
+        if (cache_pos>=0)
+            score = cache_pos<3 ? .75f : std::pow(1.f - (cache_pos-3)*(1.f/(FORSYTH_CACHE-3)), 1.5f);
+        return score + 2.f/std::sqrt(float(remaining));
+    }
+
+    void forsyth_reorder(std::vector<uint32_t> &idx, const int nverts) {
+        const int ntri = idx.size()/3;
+        std::vector<int> remaining(nverts, 0), offset(nverts+1, 0), cache_pos(nverts, -1);
+        for (uint32_t v : idx) remaining[v]++;
+        for (int v=0; v<nverts; v++) offset[v+1] = offset[v] + remaining[v];
+        // triangles of each vertex that are not emitted yet: adj[offset[v], offset[v]+remaining[v])
+        std::vector<int> adj(idx.size()), fill(offset.begin(), offset.end()-1);
+        for (int t=0; t<ntri; t++)
+            for (int k=0; k<3; k++) adj[fill[idx[t*3+k]]++] = t;
+        std::vector<float> vscore(nverts), tscore(ntri, 0.f);
+        for (int v=0; v<nverts; v++) vscore[v] = forsyth_score(-1, remaining[v]);
+        for (int t=0; t<ntri; t++) for (int k=0; k<3; k++) tscore[t] += vscore[idx[t*3+k]];
+        std::vector<char> emitted(ntri, 0);
+        std::vector<uint32_t> out;
+        out.reserve(idx.size());
+        std::vector<int> cache, next_cache;
+        int best = ntri ? int(std::max_element(tscore.begin(), tscore.end()) - tscore.begin()) : -1;
+        int scan = 0;
+        while (best>=0) {
+            emitted[best] = 1;
+            next_cache.assign(idx.begin()+best*3, idx.begin()+best*3+3);
+            for (int k=0; k<3; k++) {
+                const int v = idx[best*3+k];
+                out.push_back(v);
+                int *b = &adj[offset[v]], *e = b + remaining[v];
+                *std::find(b, e, best) = e[-1];
+                remaining[v]--;
+            }
+            for (int v : cache)
+                if (std::find(next_cache.begin(), next_cache.end(), v)==next_cache.end()) next_cache.push_back(v);
+            // refresh scores of everything whose cache position changed, including evicted vertices
+            for (size_t i=0; i<next_cache.size(); i++) {
+                const int v = next_cache[i];
+                cache_pos[v] = i<(size_t)FORSYTH_CACHE ? int(i) : -1;
+                const float score = forsyth_score(cache_pos[v], remaining[v]);
+                const float delta = score - vscore[v];
+                vscore[v] = score;
+                for (int j=offset[v]; j<offset[v]+remaining[v]; j++) tscore[adj[j]] += delta;
+            }
+            if (next_cache.size()>(size_t)FORSYTH_CACHE) next_cache.resize(FORSYTH_CACHE);
+            cache.swap(next_cache);
+            best = -1;
+            float best_score = -1.f;
+            for (int v : cache)
+                for (int j=offset[v]; j<offset[v]+remaining[v]; j++)
+                    if (tscore[adj[j]]>best_score) best_score = tscore[adj[j]], best = adj[j];
+            // the cache ran dry, continue with any triangle left
+            if (best<0) {
+                while (scan<ntri && emitted[scan]) scan++;
+                if (scan<ntri) best = scan;
+            }
+        }
+        idx.swap(out);
+    }
+}
+
+void Model::build_mesh(const std::vector<float> &positions, const std::vector<float> &uvs, const std::vector<float> &normals, const std::vector<int> &corners, const uint64_t source_hash) {
+    const auto start = std::chrono::steady_clock::now();
+    const size_t ncorners = corners.size()/3;
+    // weld bitwise identical (position, uv, normal) tuples
+    std::vector<float> welded;
+    std::vector<uint32_t> idx(ncorners);
+    {
+        WeldTable table(ncorners, welded);
+        for (size_t c=0; c<ncorners; c++) {
+            const int v = corners[c*3], t = corners[c*3+1], n = corners[c*3+2];
+            const float attr[8] = {positions[v*3], positions[v*3+1], positions[v*3+2], uvs[t*2], uvs[t*2+1],
+                                   normals[n*3], normals[n*3+1], normals[n*3+2]};
+            idx[c] = table.insert(attr);
+        }
+    }
+    const int nwelded = welded.size()/8;
+    const double hits_before = cache_hit_rate(idx, FORSYTH_CACHE);
+    forsyth_reorder(idx, nwelded);
+    const double hits_after = cache_hit_rate(idx, FORSYTH_CACHE);
+    // renumber vertices in order of first use so that vertex fetches follow the triangle order
+    std::vector<uint32_t> remap(nwelded, ~0u);
+    uint32_t next = 0;
+    for (uint32_t &v : idx) {
+        if (remap[v]==~0u) remap[v] = next++;
+        v = remap[v];
+    }
+
+    MeshHeader h;
+    std::memcpy(h.magic, MESH_MAGIC, 4);
+    h.version = MESH_VERSION;
+    h.source_hash = source_hash;
+    h.nverts = next;
+    h.nindices = idx.size();
+    owned.assign((mesh_size(h) + 3)/4, 0);
+    char *blob = reinterpret_cast<char*>(owned.data());
+    std::memcpy(blob, &h, sizeof(h));
+    float *streams = reinterpret_cast<float*>(blob + sizeof(h));
+    for (int v=0; v<nwelded; v++) {
+        if (remap[v]==~0u) continue; // only referenced by dropped faces
+        for (int k=0; k<8; k++) streams[size_t(k)*h.nverts + remap[v]] = welded[size_t(v)*8+k];
+    }
+    std::memcpy(streams + size_t(8)*h.nverts, idx.data(), idx.size()*sizeof(uint32_t));
+    bind(blob, mesh_size(h));
+
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+    const size_t bytes_before = sizeof(float)*(positions.size() + uvs.size() + normals.size()) + sizeof(int)*corners.size();
+    const size_t bytes_after = mesh_size(h) - sizeof(h);
+    std::cerr << "welded " << ncorners << " corners into " << h.nverts << " vertices, mesh " << bytes_before/1024 << " KB -> " << bytes_after/1024
+              << " KB, post-transform cache (LRU " << FORSYTH_CACHE << ") hit rate " << hits_before*100 << "% -> " << hits_after*100 << "% in " << ms << " ms" << std::endl;
+}
+
+bool Model::open_mesh(const std::string filename, const uint64_t source_hash) {
+    std::unique_ptr<MappedFile> file(new MappedFile(filename));
+    if (!file->is_open() || file->size() < sizeof(MeshHeader)) return false;
+    MeshHeader h;
+    std::memcpy(&h, file->data(), sizeof(h));
+    // a stale cache is simply rebuilt
+    if (h.source_hash != source_hash) return false;
+    if (!bind(file->data(), file->size())) return false;
+    cache = std::move(file);
+    return true;
+}
+
+bool Model::bind(const char *blob, const size_t size) {
+    MeshHeader h;
+    std::memcpy(&h, blob, sizeof(h));
+    if (std::memcmp(h.magic, MESH_MAGIC, 4) || h.version != MESH_VERSION || h.nindices % 3 || mesh_size(h) != size)
+        return false;
+    header = h;
+    const float *f = reinterpret_cast<const float*>(blob + sizeof(h));
+    vx = f; f += h.nverts;
+    vy = f; f += h.nverts;
+    vz = f; f += h.nverts;
+    tu = f; f += h.nverts;
+    tv = f; f += h.nverts;
+    nx = f; f += h.nverts;
+    ny = f; f += h.nverts;
+    nz = f; f += h.nverts;
+    indices = reinterpret_cast<const uint32_t*>(f);
+    for (uint32_t i=0; i<h.nindices; i++)
+        if (indices[i]>=h.nverts) return false;
+    return true;
+}
+
+bool Model::write_mesh(const std::string filename) const {
+    const char *blob = cache ? cache->data() : reinterpret_cast<const char*>(owned.data());
+    if (!blob) return false;
+    // write next to the target and rename, so a reader never maps a half written file
+    const std::string tmp = filename + ".tmp";
+    FILE *out = std::fopen(tmp.c_str(), "wb");
+    if (!out) return false;
+    bool ok = std::fwrite(blob, 1, mesh_size(header), out) == mesh_size(header);
+    ok = std::fclose(out) == 0 && ok;
+    if (ok) {
+        std::remove(filename.c_str());
+        ok = std::rename(tmp.c_str(), filename.c_str()) == 0;
+    }
+    if (!ok) std::remove(tmp.c_str());
+    return ok;
 }
 
 int Model::nverts() const {
-    return verts.size();
+    return header.nverts;
 }
 
 int Model::nfaces() const {
-    return facet_vrt.size()/3;
+    return header.nindices/3;
 }
 
 vec3 Model::vert(const int i) const {
-    return verts[i];
+    return {vx[i], vy[i], vz[i]};
+}
+
+const float *Model::vert_stream(const int axis) const {
+    return axis==0 ? vx : axis==1 ? vy : vz;
 }
 
 vec3 Model::vert(const int iface, const int nthvert) const {
-    return verts[facet_vrt[iface*3+nthvert]];
+    return vert(indices[iface*3+nthvert]);
 }
 
-void Model::load_texture(std::string filename, const std::string suffix, TGAImage &img) {
+int Model::vert_index(const int iface, const int nthvert) const {
+    return indices[iface*3+nthvert];
+}
+
+Texture Model::load_texture(std::string filename, const std::string suffix, const TextureLoader &loader) {
     size_t dot = filename.find_last_of(".");
-    if (dot==std::string::npos) return;
+    if (dot==std::string::npos) return {};
     std::string texfile = filename.substr(0,dot) + suffix;
-    std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
+    if (loader) return loader(texfile);
+    auto img = std::make_shared<TGAImage>();
+    const bool ok = img->read_tga_file(texfile.c_str());
+    std::cerr << "texture file " << texfile << " loading " << (ok ? "ok" : "failed") << std::endl;
+    if (!ok) return {};
+    bytes_read += file_size(texfile);
+    return Texture(std::move(img));
+}
+
+size_t Model::memory_bytes() const {
+    return header.nverts || header.nindices ? mesh_size(header) : 0;
 }
 
 vec3 Model::normal(const vec2 &uvf) const {
     TGAColor c = normalmap.get(uvf[0]*normalmap.width(), uvf[1]*normalmap.height());
-    return vec3{(double)c[2],(double)c[1],(double)c[0]}*2./255. - vec3{1,1,1};
+    return vec3{(float)c[2],(float)c[1],(float)c[0]}*2.f/255.f - vec3{1,1,1};
 }
 
 vec2 Model::uv(const int iface, const int nthvert) const {
-    return tex_coord[facet_tex[iface*3+nthvert]];
+    const int i = indices[iface*3+nthvert];
+    return {tu[i], tv[i]};
 }
 
 vec3 Model::normal(const int iface, const int nthvert) const {
-    return norms[facet_nrm[iface*3+nthvert]];
+    const int i = indices[iface*3+nthvert];
+    return {nx[i], ny[i], nz[i]};
 }
-
@@ -3,31 +3,70 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <functional>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
+#include "mapped_file.h"
+
+// Binary mesh layout, shared by the in-memory copy and the on-disk cache:
+// a MeshHeader followed by the welded vertex streams vx vy vz | u v | nx ny nz (float, SoA)
+// and one uint32 index buffer, three entries per triangle, all 4-byte aligned.
+struct MeshHeader {
+    char magic[4];            // "TRMC"
+    uint32_t version;
+    uint64_t source_hash;     // fnv1a64 of the OBJ file the mesh was built from
+    uint32_t nverts, nindices;
+};
 
 class Model {
-    std::vector<vec3> verts{};     // array of vertices
-    std::vector<vec2> tex_coord{}; // per-vertex array of tex coords
-    std::vector<vec3> norms{};     // per-vertex array of normal vectors
-    std::vector<int> facet_vrt{};
-    std::vector<int> facet_tex{};  // per-triangle indices in the above arrays
-    std::vector<int> facet_nrm{};
-    TGAImage diffusemap{};         // diffuse color texture
-    TGAImage normalmap{};          // normal map texture
-    TGAImage specularmap{};        // specular map texture
-    void load_texture(const std::string filename, const std::string suffix, TGAImage &img);
+    // streams and the index buffer point either into owned or into the mapped cache file;
+    // every vertex is a unique (position, uv, normal) tuple
+    const float *vx{}, *vy{}, *vz{};   // vertex positions
+    const float *tu{}, *tv{};          // vertex tex coords
+    const float *nx{}, *ny{}, *nz{};   // vertex normals
+    const uint32_t *indices{};         // per-triangle indices in the above arrays
+    MeshHeader header{};
+    std::vector<uint32_t> owned{};     // the mesh blob, when it was parsed from OBJ
+    std::unique_ptr<MappedFile> cache{}; // the mesh blob, when it was opened from the cache
+    Texture diffusemap{};          // diffuse color texture
+    Texture normalmap{};           // normal map texture
+    Texture specularmap{};         // specular map texture
+    size_t bytes_read{};           // read from disk while loading
+public:
+    // Returns the texture stored in texfile, or an empty handle when it can not be read
+    typedef std::function<Texture(const std::string &texfile)> TextureLoader;
+private:
+    Texture load_texture(const std::string filename, const std::string suffix, const TextureLoader &loader);
+    bool parse_obj(const char *text, const size_t size, const uint64_t source_hash);
+    // welds corners (position, uv, normal index triples) into the vertex streams, reorders for the vertex cache and packs the blob
+    void build_mesh(const std::vector<float> &positions, const std::vector<float> &uvs, const std::vector<float> &normals, const std::vector<int> &corners, const uint64_t source_hash);
+    bool open_mesh(const std::string filename, const uint64_t source_hash);
+    bool bind(const char *blob, const size_t size);
 public:
-    Model(const std::string filename);
+    // Loads <stem>.mesh if it was built from the same OBJ contents, otherwise parses the OBJ
+    // and writes the cache next to it (when use_cache is set). Textures go through loader when
+    // given, so several models can share them; otherwise each model reads its own copies.
+    Model(const std::string filename, const bool use_cache = true, const TextureLoader &loader = nullptr);
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    bool write_mesh(const std::string filename) const;
+    bool from_cache() const { return cache != nullptr; }
+    size_t disk_bytes() const { return bytes_read; }        // mesh source, cache and self-loaded textures
+    size_t memory_bytes() const;                            // mesh blob, textures excluded
     int nverts() const;
     int nfaces() const;
     vec3 normal(const int iface, const int nthvert) const; // per triangle corner normal vertex
     vec3 normal(const vec2 &uv) const;                     // fetch the normal vector from the normal map texture
     vec3 vert(const int i) const;
+    const float *vert_stream(const int axis) const; // SoA positions: 0=x, 1=y, 2=z
     vec3 vert(const int iface, const int nthvert) const;
+    int vert_index(const int iface, const int nthvert) const; // index of a triangle corner into all vertex streams
     vec2 uv(const int iface, const int nthvert) const;
-    const TGAImage& diffuse()  const { return diffusemap;  }
-    const TGAImage& specular() const { return specularmap; }
+    const Texture& diffuse()  const { return diffusemap;  }
+    const Texture& specular() const { return specularmap; }
 };
 
 #endif // !MODEL_H
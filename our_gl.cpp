@@ -1,4 +1,8 @@
 #include "our_gl.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
 
 float to_radian(float angle) {
 	float pi = 3.141592653;
@@ -56,7 +60,7 @@ mat<4, 4> get_projection(vec3 eye,vec3 center){
 mat<4, 4> get_viewport(int x, int y, int w, int h){
 	float d = 255;
 	//mat<4, 4> viewport = { {{w / 2., 0, 0, x + w / 2.}, {0, h / 2., 0, y + h / 2.}, {0,0,2 / d,2 / d}, {0,0,0,1}} };
-	mat<4, 4> viewport = { {{w / 2., 0, 0, x + w / 2.}, {0, h / 2., 0, y + h / 2.}, {0,0,1,0}, {0,0,0,1}} };
+	mat<4, 4> viewport = { {{w / 2.f, 0, 0, x + w / 2.f}, {0, h / 2.f, 0, y + h / 2.f}, {0,0,1,0}, {0,0,0,1}} };
 	return viewport;
 }
 
@@ -64,6 +68,64 @@ vec4 Homogenization(vec4 v) {
 	return { v[0] / v[3],v[1] / v[3],v[2] / v[3],v[3]};
 }
 
+void Uniforms::update_mvp() {
+	mvp_ = viewport_ * projection_ * lookat_ * model_;
+}
+
+void Uniforms::update_normal_matrix() {
+	normal_matrix_ = inverse(model_).transpose().get_minor(3, 3);
+}
+
+//еۼ˳mat<4,4>*vec4ͬ((x+y)+(z+w)),֤λһ
+static void transform_scalar(const Model& model, const mat<4, 4>& m, int begin, VertexBuffer& vb) {
+	for (int i = begin; i < vb.size(); i++) {
+		vec3 p = model.vert(i);
+		float r[4];
+		for (int j = 0; j < 4; j++) r[j] = (m[j][0] * p.x + m[j][1] * p.y) + (m[j][2] * p.z + m[j][3]);
+		vb.x[i] = r[0] / r[3];
+		vb.y[i] = r[1] / r[3];
+		vb.z[i] = r[2] / r[3];
+		vb.w[i] = r[3];
+	}
+}
+
+#ifdef USE_X86_SIMD
+//ÿα任8,شĶ,ʣĽ
+TARGET_AVX2 static int transform_avx2(const Model& model, const mat<4, 4>& m, VertexBuffer& vb) {
+	int n = vb.size() & ~7;
+	//ModelSoAŶ,ֱȡ
+	const float* xs = model.vert_stream(0), * ys = model.vert_stream(1), * zs = model.vert_stream(2);
+	for (int i = 0; i < n; i += 8) {
+		__m256 px = _mm256_loadu_ps(xs + i), py = _mm256_loadu_ps(ys + i), pz = _mm256_loadu_ps(zs + i);
+		__m256 r[4];
+		for (int j = 0; j < 4; j++) {
+			__m256 xy = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[j][0]), px), _mm256_mul_ps(_mm256_set1_ps(m[j][1]), py));
+			__m256 zw = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[j][2]), pz), _mm256_set1_ps(m[j][3]));
+			r[j] = _mm256_add_ps(xy, zw);
+		}
+		_mm256_storeu_ps(&vb.x[i], _mm256_div_ps(r[0], r[3]));
+		_mm256_storeu_ps(&vb.y[i], _mm256_div_ps(r[1], r[3]));
+		_mm256_storeu_ps(&vb.z[i], _mm256_div_ps(r[2], r[3]));
+		_mm256_storeu_ps(&vb.w[i], r[3]);
+	}
+	return n;
+}
+#endif
+
+void VertexBuffer::transform(const Model& model, const mat<4, 4>& mvp) {
+	int n = model.nverts();
+	x.resize(n), y.resize(n), z.resize(n), w.resize(n);
+	int done = 0;
+#ifdef USE_X86_SIMD
+	if (cpu_has_avx2()) done = transform_avx2(model, mvp, *this);
+#endif
+	transform_scalar(model, mvp, done, *this);
+}
+
+std::array<vec4, 3> VertexBuffer::triangle(const Model& model, const int iface) const {
+	return { (*this)[model.vert_index(iface, 0)], (*this)[model.vert_index(iface, 1)], (*this)[model.vert_index(iface, 2)] };
+}
+
 void line(int x0, int y0, int x1, int y1, TGAImage& image, const TGAColor& color) {
 	bool steep = false;
 	if (std::abs(x0 - x1) < std::abs(y0 - y1)) {
@@ -93,133 +155,344 @@ void line(int x0, int y0, int x1, int y1, TGAImage& image, const TGAColor& color
 }
 
 void triangle(std::array<vec4,3> v, Shader& shader, float* zbuffer, TGAImage& image) {
+	triangle(v, shader, zbuffer, image, 0, 0, image.width() - 1, image.height() - 1);
+}
+
+bool TriangleSetup::setup(const std::array<vec4, 3>& v) {
+	double X[3], Y[3];
+	for (int i = 0; i < 3; i++) {
+		X[i] = std::round(v[i].x * SUBPIXEL);
+		Y[i] = std::round(v[i].y * SUBPIXEL);
+	}
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3, k = (i + 2) % 3;
+		a[i] = Y[j] - Y[k];
+		b[i] = X[k] - X[j];
+		c[i] = X[j] * Y[k] - X[k] * Y[j];
+	}
+	double area = c[0] + c[1] + c[2];
 	//˻һ
-	if ((v[0].x == v[1].x && v[1].x == v[2].x) || (v[0].y == v[1].y && v[1].y == v[2].y)) return;
-	//ҵboundingBox
-	auto [left, right, bottom, top] = boundingBox(v);
-	//ü
-	if (left < 0) left = 0;if (bottom < 0) bottom = 0;
-	if (right > image.width()) right = image.width() - 1;if (top > image.height()) top = image.height() - 1;
-	//ȡ
-	auto get_index = [&](int x, int y) -> int {
-		return x + y * image.width();
-	};
-	//z
-	for (vec4& coord : v) coord.z = coord.z * coord.w;
-	//Ⱦ
-	for (int x = left; x <= right; x++) {
-		for (int y = bottom; y <= top; y++) {
-			//auto [alpha, beta, gamma] = computeBarycentric2D(x + 0.5, y + 0.5, v);
-			auto bary_coords = computeBarycentric2D(x , y , v);
-			if (bary_coords[0] < 0 || bary_coords[1] < 0 || bary_coords[2] < 0)	continue;
-
-			//float z_interpolated = bary_coords[0] * v[0].z + bary_coords[1] * v[1].z + bary_coords[2] * v[2].z;
-			
+	if (area == 0) return false;
+	//˳ʱηתߺ,֤ڲΪ
+	if (area < 0) {
+		for (int i = 0; i < 3; i++) a[i] = -a[i], b[i] = -b[i], c[i] = -c[i];
+		area = -area;
+	}
+	for (int i = 0; i < 3; i++) {
+		bias[i] = (a[i] > 0 || (a[i] == 0 && b[i] > 0)) ? 0 : -1;
+		step_x[i] = a[i] * SUBPIXEL;
+		step_y[i] = b[i] * SUBPIXEL;
+	}
+	inv_area = 1. / area;
+	return true;
+}
+
+typedef int (*Span8)(const TriangleSetup& tri, const double e[3], const double vz[3], const float* depth, int count, float z[8], vec3 bary[8]);
+
+static int span8_scalar(const TriangleSetup& tri, const double e[3], const double vz[3], const float* depth, int count, float z[8], vec3 bary[8]) {
+	double ei[3] = { e[0], e[1], e[2] };
+	int mask = 0;
+	for (int k = 0; k < count; k++) {
+		if (tri.inside(ei)) {
+			dvec3 bary_coords = { ei[0] * tri.inv_area, ei[1] * tri.inv_area, ei[2] * tri.inv_area };
 			//
-			for (int i = 0; i < 3; i++) bary_coords[i] /= v[i].z;
+			for (int i = 0; i < 3; i++) bary_coords[i] /= vz[i];
 			float z_interpolated = 1.f / (bary_coords[0] + bary_coords[1] + bary_coords[2]);
 			for (int i = 0; i < 3; i++) bary_coords[i] *= z_interpolated;
+			if (depth[k] < z_interpolated) {
+				mask |= 1 << k;
+				z[k] = z_interpolated;
+				bary[k] = vec3(bary_coords.x, bary_coords.y, bary_coords.z);
+			}
+		}
+		for (int i = 0; i < 3; i++) ei[i] += tri.step_x[i];
+	}
+	return mask;
+}
+
+#ifdef USE_X86_SIMD
+//span8_scalarλһ:ߺֵǾȷ,˳;ͬ
+TARGET_AVX2 static int span8_avx2(const TriangleSetup& tri, const double e[3], const double vz[3], const float* depth, int count, float z[8], vec3 bary[8]) {
+	const __m256d lane_lo = _mm256_set_pd(3, 2, 1, 0), lane_hi = _mm256_set_pd(7, 6, 5, 4), zero = _mm256_setzero_pd();
+	__m256d e_lo[3], e_hi[3];
+	__m256d cover_lo = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ), cover_hi = cover_lo;
+	//ǲ
+	for (int i = 0; i < 3; i++) {
+		__m256d base = _mm256_set1_pd(e[i]), step = _mm256_set1_pd(tri.step_x[i]), bias = _mm256_set1_pd(tri.bias[i]);
+		e_lo[i] = _mm256_add_pd(base, _mm256_mul_pd(lane_lo, step));
+		e_hi[i] = _mm256_add_pd(base, _mm256_mul_pd(lane_hi, step));
+		cover_lo = _mm256_and_pd(cover_lo, _mm256_cmp_pd(_mm256_add_pd(e_lo[i], bias), zero, _CMP_GE_OQ));
+		cover_hi = _mm256_and_pd(cover_hi, _mm256_cmp_pd(_mm256_add_pd(e_hi[i], bias), zero, _CMP_GE_OQ));
+	}
+	int mask = (_mm256_movemask_pd(cover_lo) | (_mm256_movemask_pd(cover_hi) << 4)) & ((1 << count) - 1);
+	if (!mask) return 0;
+	//
+	const __m256d inv_area = _mm256_set1_pd(tri.inv_area), one = _mm256_set1_pd(1.);
+	__m256d b_lo[3], b_hi[3];
+	for (int i = 0; i < 3; i++) {
+		__m256d w = _mm256_set1_pd(vz[i]);
+		b_lo[i] = _mm256_div_pd(_mm256_mul_pd(e_lo[i], inv_area), w);
+		b_hi[i] = _mm256_div_pd(_mm256_mul_pd(e_hi[i], inv_area), w);
+	}
+	__m128 z_lo = _mm256_cvtpd_ps(_mm256_div_pd(one, _mm256_add_pd(_mm256_add_pd(b_lo[0], b_lo[1]), b_lo[2])));
+	__m128 z_hi = _mm256_cvtpd_ps(_mm256_div_pd(one, _mm256_add_pd(_mm256_add_pd(b_hi[0], b_hi[1]), b_hi[2])));
+	//Ȳ
+	float depth8[8] = {};
+	for (int k = 0; k < count; k++) depth8[k] = depth[k];
+	mask &= _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth8), z_lo)) | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth8 + 4), z_hi)) << 4);
+	if (!mask) return 0;
+	_mm_storeu_ps(z, z_lo);
+	_mm_storeu_ps(z + 4, z_hi);
+	double out[3][8];
+	__m256d zd_lo = _mm256_cvtps_pd(z_lo), zd_hi = _mm256_cvtps_pd(z_hi);
+	for (int i = 0; i < 3; i++) {
+		_mm256_storeu_pd(out[i], _mm256_mul_pd(b_lo[i], zd_lo));
+		_mm256_storeu_pd(out[i] + 4, _mm256_mul_pd(b_hi[i], zd_hi));
+	}
+	for (int k = 0; k < 8; k++)
+		if (mask >> k & 1) bary[k] = vec3(out[0][k], out[1][k], out[2][k]);
+	return mask;
+}
+#endif
+
+static Span8 select_span8() {
+#ifdef USE_X86_SIMD
+	if (cpu_has_avx2()) return span8_avx2;
+#endif
+	return span8_scalar;
+}
 
-			if (zbuffer[get_index(x, y)] < z_interpolated) {
-				zbuffer[get_index(x, y)] = z_interpolated;
-				auto color = shader.fragment(bary_coords);
-				if (color.has_value())
-					image.set(x, y, *color);
+static const Span8 span8_kernel = select_span8();
+
+int span8(const TriangleSetup& tri, const double e[3], const double vz[3], const float* depth, int count, float z[8], vec3 bary[8]) {
+	return span8_kernel(tri, e, vz, depth, count, z, bary);
+}
+
+typedef int (*DepthSpan8)(const TriangleSetup& tri, const double e[3], const double k[3], float* depth, int count);
+
+static int depth_span8_scalar(const TriangleSetup& tri, const double e[3], const double k[3], float* depth, int count) {
+	double ei[3] = { e[0], e[1], e[2] };
+	int mask = 0;
+	for (int j = 0; j < count; j++) {
+		if (tri.inside(ei)) {
+			float z = 1. / (ei[0] * k[0] + ei[1] * k[1] + ei[2] * k[2]);
+			if (depth[j] < z) {
+				depth[j] = z;
+				mask |= 1 << j;
 			}
 		}
+		for (int i = 0; i < 3; i++) ei[i] += tri.step_x[i];
 	}
+	return mask;
 }
 
-void ssaa_triangle(std::array<vec4, 3> v, Shader& shader, float* zbuffer, TGAImage& image, float** ssaa_zbuffer, vec3** ssaa_framebuffer) {
-	//˻һ
-	if ((v[0].x == v[1].x && v[1].x == v[2].x) || (v[0].y == v[1].y && v[1].y == v[2].y)) return;
-	//ҵboundingBox
-	auto [left, right, bottom, top] = boundingBox(v);
-	//ü
-	if (left < 0) left = 0; if (bottom < 0) bottom = 0;
-	if (right > image.width()) right = image.width() - 1; if (top > image.height()) top = image.height() - 1;
-	//ȡ
-	auto get_index = [&](int x, int y) -> int {
-		return x + y * image.width();
-	};
-	//z
-	for (vec4& coord : v) coord.z = coord.z * coord.w;
-	 //bonding box
-	for (float x = left; x <= right; x++)
-		for (float y = bottom; y <= top; y++) {
-			int index = 0;
-			for (float i = 0.25f; i < 1.0f; i += 0.5f) {
-				for (float j = 0.25f; j < 1.0f; j += 0.5f, index++) {
-					//ȡ
-					auto bary_coords = computeBarycentric2D(x+i, y+j, v);
-					if (bary_coords[0] < 0 || bary_coords[1] < 0 || bary_coords[2] < 0)	continue;
-					//
-					for (int i = 0; i < 3; i++) bary_coords[i] /= v[i].z;
-					float z_interpolated = 1.f / (bary_coords[0] + bary_coords[1] + bary_coords[2]);
-					for (int i = 0; i < 3; i++) bary_coords[i] *= z_interpolated;
-					//Ȳ
-					if (ssaa_zbuffer[get_index(x, y)][index] < z_interpolated) {
-						ssaa_zbuffer[get_index(x, y)][index] = z_interpolated;
-						//Ⱦ
-						auto color = shader.fragment(bary_coords);
-						if (color.has_value())
-							ssaa_framebuffer[get_index(x, y)][index] = {(double)color->bgra[2],(double)color->bgra[1],(double)color->bgra[0]};
-					}
-					
-				}
+#ifdef USE_X86_SIMD
+//depth_span8_scalarλһ
+TARGET_AVX2 static int depth_span8_avx2(const TriangleSetup& tri, const double e[3], const double k[3], float* depth, int count) {
+	const __m256d lane_lo = _mm256_set_pd(3, 2, 1, 0), lane_hi = _mm256_set_pd(7, 6, 5, 4), zero = _mm256_setzero_pd();
+	__m256d cover_lo = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ), cover_hi = cover_lo;
+	__m256d inv_lo = zero, inv_hi = zero;
+	for (int i = 0; i < 3; i++) {
+		__m256d base = _mm256_set1_pd(e[i]), step = _mm256_set1_pd(tri.step_x[i]), bias = _mm256_set1_pd(tri.bias[i]), ki = _mm256_set1_pd(k[i]);
+		__m256d e_lo = _mm256_add_pd(base, _mm256_mul_pd(lane_lo, step));
+		__m256d e_hi = _mm256_add_pd(base, _mm256_mul_pd(lane_hi, step));
+		cover_lo = _mm256_and_pd(cover_lo, _mm256_cmp_pd(_mm256_add_pd(e_lo, bias), zero, _CMP_GE_OQ));
+		cover_hi = _mm256_and_pd(cover_hi, _mm256_cmp_pd(_mm256_add_pd(e_hi, bias), zero, _CMP_GE_OQ));
+		//i=0ʱ0+x=x,ͱ(e0*k0+e1*k1)+e2*k2˳ͬ
+		inv_lo = _mm256_add_pd(inv_lo, _mm256_mul_pd(e_lo, ki));
+		inv_hi = _mm256_add_pd(inv_hi, _mm256_mul_pd(e_hi, ki));
+	}
+	int mask = (_mm256_movemask_pd(cover_lo) | (_mm256_movemask_pd(cover_hi) << 4)) & ((1 << count) - 1);
+	if (!mask) return 0;
+	const __m256d one = _mm256_set1_pd(1.);
+	__m128 z_lo = _mm256_cvtpd_ps(_mm256_div_pd(one, inv_lo));
+	__m128 z_hi = _mm256_cvtpd_ps(_mm256_div_pd(one, inv_hi));
+	float depth8[8] = {}, z[8];
+	for (int j = 0; j < count; j++) depth8[j] = depth[j];
+	mask &= _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth8), z_lo)) | (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(depth8 + 4), z_hi)) << 4);
+	if (!mask) return 0;
+	_mm_storeu_ps(z, z_lo);
+	_mm_storeu_ps(z + 4, z_hi);
+	for (int j = 0; j < 8; j++)
+		if (mask >> j & 1) depth[j] = z[j];
+	return mask;
+}
+#endif
+
+static DepthSpan8 select_depth_span8() {
+#ifdef USE_X86_SIMD
+	if (cpu_has_avx2()) return depth_span8_avx2;
+#endif
+	return depth_span8_scalar;
+}
+
+static const DepthSpan8 depth_span8_kernel = select_depth_span8();
+
+int depth_span8(const TriangleSetup& tri, const double e[3], const double k[3], float* depth, int count) {
+	return depth_span8_kernel(tri, e, k, depth, count);
+}
+
+std::ostream& operator<<(std::ostream& out, const CullStats& s) {
+	return out << "primitives " << s.primitives << " (back faces " << s.backface_culled << ", outside " << s.frustum_culled << ", clipped " << s.clipped
+		<< "), triangles " << s.triangles << " (culled " << s.triangles_culled << "), 8x8 blocks " << s.blocks << " (culled " << s.blocks_culled << ")";
+}
+
+struct ClipVertex {
+	vec4 h;     //Ļ(x*w,y*w,z*w,w)
+	vec3 bary;  //ԭ
+};
+
+//ƽ0ǽƽ,1-4x>=lo,x<=hi,y>=lo,y<=hi;ƽڲʱǸ.Ƿ,Բֵ
+static float plane_distance(const vec4& h, int plane, float x_lo, float x_hi, float y_lo, float y_hi) {
+	switch (plane) {
+	case 0: return h.w - W_NEAR;
+	case 1: return h.x - x_lo * h.w;
+	case 2: return x_hi * h.w - h.x;
+	case 3: return h.y - y_lo * h.w;
+	default: return y_hi * h.w - h.y;
+	}
+}
+
+int assemble(const std::array<vec4, 3>& v, CullFace cull, int width, int height, Primitive out[MAX_PRIMITIVES], CullStats* stats) {
+	CullStats unused;
+	CullStats& s = stats ? *stats : unused;
+	s.primitives++;
+	//VertexBufferѾ͸ӳ,˻wԭ;wΪ0ʱԭ,
+	vec4 h[3];
+	for (int i = 0; i < 3; i++) {
+		if (v[i].w == 0 || !std::isfinite(v[i].x) || !std::isfinite(v[i].y) || !std::isfinite(v[i].z)) {
+			s.frustum_culled++;
+			return 0;
+		}
+		h[i] = vec4(v[i].x * v[i].w, v[i].y * v[i].w, v[i].z * v[i].w, v[i].w);
+	}
+	//(x,y,w)ʽķ=Ļķ*w0*w1*w2ķ,ڽƽʱҲжϳ
+	if (cull != CullFace::None) {
+		double det = 0;
+		for (int i = 0; i < 3; i++) {
+			const int j = (i + 1) % 3, k = (i + 2) % 3;
+			det += (double)h[i].w * ((double)h[j].x * h[k].y - (double)h[k].x * h[j].y);
+		}
+		if (cull == CullFace::Back ? det < 0 : det > 0) {
+			s.backface_culled++;
+			return 0;
+		}
+	}
+	//㶼Ļͬһƽʱɼ;ֻпƽ򳬳Ҫü
+	int clip_planes = 0;
+	for (int p = 0; p < 5; p++) {
+		int outside = 0, outside_guard = 0;
+		for (int i = 0; i < 3; i++) {
+			outside += plane_distance(h[i], p, 0, (float)width, 0, (float)height) < 0;
+			outside_guard += plane_distance(h[i], p, -GUARD_BAND, (float)(width + GUARD_BAND), -GUARD_BAND, (float)(height + GUARD_BAND)) < 0;
+		}
+		if (outside == 3) {
+			s.frustum_culled++;
+			return 0;
+		}
+		if (outside_guard) clip_planes |= 1 << p;
+	}
+	if (!clip_planes) {
+		out[0].v = v;
+		out[0].clipped = false;
+		return 1;
+	}
+
+	//Sutherland-Hodgman,͹ÿһƽһ;
+	ClipVertex buf[2][16];
+	ClipVertex* poly = buf[0], * next = buf[1];
+	int n = 3;
+	for (int i = 0; i < 3; i++) {
+		poly[i].h = h[i];
+		poly[i].bary = vec3(i == 0, i == 1, i == 2);
+	}
+	for (int p = 0; p < 5 && n >= 3; p++) {
+		if (!(clip_planes >> p & 1)) continue;
+		int m = 0;
+		for (int i = 0; i < n && m < 15; i++) {
+			const ClipVertex& a = poly[i], & b = poly[(i + 1) % n];
+			const float da = plane_distance(a.h, p, -GUARD_BAND, (float)(width + GUARD_BAND), -GUARD_BAND, (float)(height + GUARD_BAND));
+			const float db = plane_distance(b.h, p, -GUARD_BAND, (float)(width + GUARD_BAND), -GUARD_BAND, (float)(height + GUARD_BAND));
+			if (da >= 0) next[m++] = a;
+			if ((da >= 0) != (db >= 0)) {
+				const float t = da / (da - db);
+				next[m++] = { a.h + (b.h - a.h) * t, a.bary + (b.bary - a.bary) * t };
 			}
 		}
-	//ֵ
-	for (float x = left; x < right; x++)
-		for (float y = bottom; y < top; y++) {
-			vec3 color = { 0,0,0 };
-			for (int i = 0; i < 4; i++)
-				color = color + ssaa_framebuffer[get_index(x, y)][i];
-			color = color / 4;
-			image.set(x, y, TGAColor(color.x,color.y,color.z,255));
+		std::swap(poly, next);
+		n = m;
+	}
+	if (n < 3) {
+		s.frustum_culled++;
+		return 0;
+	}
+	s.clipped++;
+	n = std::min(n, MAX_PRIMITIVES + 2);
+	//ԵһΪǻ
+	for (int t = 0; t < n - 2; t++) {
+		const ClipVertex* c[3] = { &poly[0], &poly[t + 1], &poly[t + 2] };
+		for (int j = 0; j < 3; j++) {
+			const vec4& p = c[j]->h;
+			out[t].v[j] = vec4(p.x / p.w, p.y / p.w, p.z / p.w, p.w);
+			for (int r = 0; r < 3; r++) out[t].bary[r][j] = c[j]->bary[r];
 		}
+		out[t].clipped = true;
+	}
+	return n - 2;
 }
 
-TGAColor getColorBilinear(TGAImage& texture, vec2 uv) {
-	float width = texture.width(), height = texture.height();
-	float u_img = uv.x * width, v_img = uv.y * height;
-	//޶
-	if (u_img < 0) u_img = 0;
-	if (u_img >= width) u_img = width - 1;
-	if (v_img < 0) v_img = 0;
-	if (v_img >= height) v_img = height - 1;
-	//
-	vec2 center = { std::round(u_img),std::round(v_img) };
-	float step = 0.5f;
-	std::array<vec2, 4> points = {
-		vec2(center.x - step,center.y - step),
-		vec2(center.x + step,center.y - step),
-		vec2(center.x - step,center.y + step),
-		vec2(center.x + step,center.y + step)
-	};
-	//ɫ
-	auto color = [&](const vec2& point) -> vec3 {
-		TGAColor res = point.x >= 0 && point.x <= width && point.y >= 0 && point.y <= height ? texture.get(point.x, point.y) : texture.get(u_img, v_img);
-		return { (double)res.bgra[2],(double)res.bgra[1],(double)res.bgra[0] };
-	};
-	std::array<vec3, 4> colors = {
-		color(points[0]),
-		color(points[1]),
-		color(points[2]),
-		color(points[3])
-	};
-	//вֵ
-	float s = (u_img - points[0].x) / (step * 2), t = (v_img - points[0].y) / (step * 2);
-	vec3 color1 = s * colors[1] + (1 - s) * colors[0], color2 = s * colors[3] + (1 - s) * colors[2];
-	vec3 res_color = t * color2 + (1 - t) * color1;
-	return TGAColor(res_color.x, res_color.y, res_color.z, 255);
-}
-
-vec3 rand_point_on_unit_sphere() {
-	constexpr double pi = 3.141592653;
-	float u = (float)rand() / (float)RAND_MAX;
-	float v = (float)rand() / (float)RAND_MAX;
-	float theta = 2.f * pi * u;
-	float phi = acos(2.f * v - 1.f);
-	return vec3(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi));
-}
\ No newline at end of file
+//D3D׼ģʽ,λ,λ1/16
+static const signed char PATTERN2[2][2] = { {4, 4}, {-4, -4} };
+static const signed char PATTERN4[4][2] = { {-2, -6}, {6, -2}, {-6, 2}, {2, 6} };
+static const signed char PATTERN8[8][2] = { {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7} };
+
+MultisampleBuffer::MultisampleBuffer(int width, int height, int samples)
+	: w(width), h(height), n(samples == 2 || samples == 8 ? samples : 4),
+	pattern(n == 2 ? PATTERN2 : n == 8 ? PATTERN8 : PATTERN4), depths((size_t)w * h * n), colors((size_t)w * h * n) {
+	clear();
+}
+
+void MultisampleBuffer::clear() {
+	std::fill(depths.begin(), depths.end(), -std::numeric_limits<float>::max());
+	std::fill(colors.begin(), colors.end(), 0u);
+}
+
+void MultisampleBuffer::resolve(TGAImage& image) const {
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			const std::uint32_t* samples = colors.data() + ((size_t)x + (size_t)y * w) * n;
+			unsigned sum[3] = {};
+			for (int s = 0; s < n; s++)
+				for (int c = 0; c < 3; c++) sum[c] += samples[s] >> (8 * c) & 0xff;
+			image.set(x, y, TGAColor(sum[2] / n, sum[1] / n, sum[0] / n, 255));
+		}
+}
+
+HierarchicalZ::HierarchicalZ(float* zbuffer, int width, int height)
+	: zbuffer(zbuffer), w(width), h(height), bw((width + BLOCK - 1) / BLOCK), bh((height + BLOCK - 1) / BLOCK), mins(bw * bh) {
+	for (int by = 0; by < bh; by++)
+		for (int bx = 0; bx < bw; bx++)
+			update(bx, by);
+}
+
+float HierarchicalZ::min_depth(int bx0, int by0, int bx1, int by1) const {
+	float zmin = std::numeric_limits<float>::max();
+	for (int by = by0; by <= by1; by++)
+		for (int bx = bx0; bx <= bx1; bx++)
+			zmin = std::min(zmin, mins[bx + by * bw]);
+	return zmin;
+}
+
+void HierarchicalZ::update(int bx, int by) {
+	int x0 = bx * BLOCK, y0 = by * BLOCK;
+	int x1 = std::min(x0 + BLOCK, w), y1 = std::min(y0 + BLOCK, h);
+	float zmin = std::numeric_limits<float>::max();
+	for (int y = y0; y < y1; y++)
+		for (int x = x0; x < x1; x++)
+			zmin = std::min(zmin, zbuffer[x + y * w]);
+	mins[bx + by * bw] = zmin;
+}
+
+void triangle(std::array<vec4, 3> v, Shader& shader, float* zbuffer, TGAImage& image, int x0, int y0, int x1, int y1) {
+	draw<Shader>(v, shader, zbuffer, image, x0, y0, x1, y1);
+}
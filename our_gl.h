@@ -8,6 +8,11 @@
 #include <tuple>
 #include <optional>
 #include <array>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <limits>
+#include <ostream>
 
 //
 struct Light{
@@ -29,10 +34,71 @@ struct Material {
 	float shininess;
 };
 
+//ɫ:ͨset_*޸,MVPͷ߾set_*,
+//getterֻ,ȥɫԱ߳ͬʱ
+class Uniforms {
+public:
+	void set_projection(const mat<4, 4>& m) { projection_ = m; update_mvp(); }
+	void set_viewport(const mat<4, 4>& m) { viewport_ = m; update_mvp(); }
+	void set_lookat(const mat<4, 4>& m) { lookat_ = m; update_mvp(); }
+	void set_model(const mat<4, 4>& m) { model_ = m; update_mvp(); update_normal_matrix(); }
+	//Դռ,ͼһMVP
+	void set_light_space(const mat<4, 4>& m) { light_space_ = m; }
+
+	const mat<4, 4>& projection() const { return projection_; }
+	const mat<4, 4>& viewport() const { return viewport_; }
+	const mat<4, 4>& lookat() const { return lookat_; }
+	const mat<4, 4>& model() const { return model_; }
+	const mat<4, 4>& light_space() const { return light_space_; }
+	//viewport * projection * lookat * model
+	const mat<4, 4>& mvp() const { return mvp_; }
+	//modelתõ3x3
+	const mat<3, 3>& normal_matrix() const { return normal_matrix_; }
+
+private:
+	void update_mvp();
+	void update_normal_matrix();
+
+	mat<4, 4> projection_ = mat<4, 4>::identity();
+	mat<4, 4> viewport_ = mat<4, 4>::identity();
+	mat<4, 4> lookat_ = mat<4, 4>::identity();
+	mat<4, 4> model_ = mat<4, 4>::identity();
+	mat<4, 4> light_space_ = mat<4, 4>::identity();
+	mat<4, 4> mvp_ = mat<4, 4>::identity();
+	mat<3, 3> normal_matrix_ = mat<3, 3>::identity();
+};
+
+//޳:Ļyʱʱ
+enum class CullFace { None, Back, Front };
+
 class Shader {
 public:
+	Uniforms uniforms;
+	CullFace cull_face = CullFace::Back;
+
 	virtual std::array<vec4,3> vertex(std::array<vec3,3> world_coords) = 0;
+	//ĻVertexBufferʱ,ֻ׼varying
+	virtual std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords, std::array<vec4, 3> /*screen_coords*/) { return vertex(world_coords); }
 	virtual std::optional<TGAColor> fragment(vec3 bar) = 0;
+	//դÿװõ֮ǰ,vĻ,remapPrimitive.
+	//ҪĻʵʹդ׼ݵɫ,ɫ;ַ̬
+	void primitive(const std::array<vec4, 3>& /*v*/, const mat<3, 3>* /*remap*/) {}
+
+	//ֻд,ɫɫΪtrue,draw()ɲfragment()ѭ
+	static constexpr bool depth_only = false;
+};
+
+//㴦׶:ÿλưModelжͬһMVP任һ,SoA,
+//㲻ظ任,װʱȡ
+struct VertexBuffer {
+	std::vector<float> x, y, z, w;
+
+	//Homogenization(mvp * v),𶥵Ľλһ
+	void transform(const Model& model, const mat<4, 4>& mvp);
+	int size() const { return (int)x.size(); }
+	vec4 operator[](const int i) const { return { x[i], y[i], z[i], w[i] }; }
+	//װiface
+	std::array<vec4, 3> triangle(const Model& model, const int iface) const;
 };
 
 float to_radian(float angle);
@@ -70,6 +136,23 @@ vec3 computeBarycentric2D(float x, float y, const T v) {
 	return { alpha,beta,gamma };
 }
 
+//ν:궨㻯1/256,ߺE_i=a_i*X+b_i*Y+c_iֻһ,
+//դʱ.ֵ,doubleſԾȷʾ,ۻ
+struct TriangleSetup {
+	static constexpr int SUBPIXEL = 256;
+
+	double a[3], b[3], c[3];  //i߶ŵi,ڲE_i>0
+	double bias[3];           //Ϲ:ֻߺϱϵĵ㸲
+	double step_x[3], step_y[3]; //,ƶһʱE_i
+	double inv_area;          //E_i*inv_area
+
+	//˻ηfalse
+	bool setup(const std::array<vec4, 3>& v);
+	//(x,y)ıߺֵ
+	double edge(int i, int x, int y) const { return a[i] * x * SUBPIXEL + b[i] * y * SUBPIXEL + c[i]; }
+	bool inside(const double e[3]) const { return e[0] + bias[0] >= 0 && e[1] + bias[1] >= 0 && e[2] + bias[2] >= 0; }
+};
+
 template <typename T>
 T interpolate(float alpha, float beta, float gamma, T vert1, T vert2, T vert3, float weight) {
 	//return (alpha * vert1 + beta * vert2 + gamma * vert3) / weight;
@@ -78,12 +161,313 @@ T interpolate(float alpha, float beta, float gamma, T vert1, T vert2, T vert3, f
 
 void line(int x0, int x1, int y0, int y1, TGAImage& image, const TGAColor& color);
 
-void triangle(std::array<vec4,3> v,Shader& shader,float* zbuffer,TGAImage& image);
+//һӱߺֵeʼcount(<=8):ǲ,͸ӽȲһ
+//ͨԵ,zbaryֻеЧ.֧AVX2ʱָ
+int span8(const TriangleSetup& tri, const double e[3], const double vz[3], const float* depth, int count, float z[8], vec3 bary[8]);
+
+//ֻдȵspan8:1/zĻռԵ,sum(E_i*k_i),k_i=inv_area/vz_i
+//,ͨȲԵֱдdepth,д
+int depth_span8(const TriangleSetup& tri, const double e[3], const double k[3], float* depth, int count);
+
+inline int popcount8(int mask) {
+	int n = 0;
+	for (; mask; mask &= mask - 1) n++;
+	return n;
+}
+
+//ڲֵȵϽ.͸ӽzz(˹w)ļȨƽ,ᳬ;
+//zŻΪ0ʱƽûн,FLT_MAX
+inline float max_depth(const std::array<vec4, 3>& v) {
+	float vz[3];
+	for (int i = 0; i < 3; i++) vz[i] = v[i].z * v[i].w;
+	bool positive = vz[0] > 0 && vz[1] > 0 && vz[2] > 0, negative = vz[0] < 0 && vz[1] < 0 && vz[2] < 0;
+	if (!positive && !negative) return std::numeric_limits<float>::max();
+	return std::max(vz[0], std::max(vz[1], vz[2]));
+}
+
+//ֲ޳ļ
+struct CullStats {
+	long long primitives = 0, backface_culled = 0;  //ͼԪװ:,޳
+	long long frustum_culled = 0, clipped = 0;      //Ļƽ,ü
+	long long triangles = 0, triangles_culled = 0;  //α޳
+	long long blocks = 0, blocks_culled = 0;        //θǵ8x8鱻޳
+
+	CullStats& operator+=(const CullStats& o) {
+		primitives += o.primitives, backface_culled += o.backface_culled;
+		frustum_culled += o.frustum_culled, clipped += o.clipped;
+		triangles += o.triangles, triangles_culled += o.triangles_culled;
+		blocks += o.blocks, blocks_culled += o.blocks_culled;
+		return *this;
+	}
+};
+
+std::ostream& operator<<(std::ostream& out, const CullStats& s);
+
+//ͼԪװ:Ļ,Լԭ(jжӦj),fragment()յҪȳ
+struct Primitive {
+	std::array<vec4, 3> v;
+	mat<3, 3> bary;
+	bool clipped;
+};
+
+//ƽ.wĲֱõ,͸ӳ0
+constexpr float W_NEAR = 1e-4f;
+//:Ļôصβü,դİΧнض;
+//ԶĲŲü,֤㻯ߺĳ˻doubleȷʾ
+constexpr int GUARD_BAND = 8192;
+//ƽ4ƽβó8
+constexpr int MAX_PRIMITIVES = 6;
+
+//޳,Ļƽ޳,Ҫʱοռü.
+//,ûвüʱout[0].vv.ۼӵstats(Ϊ)
+int assemble(const std::array<vec4, 3>& v, CullFace cull, int width, int height, Primitive out[MAX_PRIMITIVES], CullStats* stats);
+
+//ͼԪװfn(v, remap),remapûвüʱΪ,fnֵ֮
+template <typename Fn>
+int for_each_primitive(const std::array<vec4, 3>& v, CullFace cull, int width, int height, CullStats* stats, Fn&& fn) {
+	Primitive prims[MAX_PRIMITIVES];
+	const int n = assemble(v, cull, width, height, prims, stats);
+	int written = 0;
+	for (int i = 0; i < n; i++) written += fn(prims[i].v, prims[i].clipped ? &prims[i].bary : nullptr);
+	return written;
+}
 
-void ssaa_triangle(std::array<vec4, 3> v, Shader& shader, float* zbuffer, TGAImage& image, float** ssaa_zbuffer, vec3** ssaa_framebuffer);
+//ֲȻ:ƽ̵zbuffer֮ϰ8x8¼ȵ½(ԽԽ,½缴Զ).
+//Ͻ粻½ʱ,ÿصȲԶȻʧ,ο.
+//draw()дһupdate()ÿ,߳ʱÿֻ߳дԼڵĿ
+class HierarchicalZ {
+public:
+	static constexpr int BLOCK = 8;
+
+	//ӵzbuffer,ʱɨһ齨½
+	HierarchicalZ(float* zbuffer, int width, int height);
+
+	float* data() const { return zbuffer; }
+	int width() const { return w; }
+	int height() const { return h; }
+	float block_min(int bx, int by) const { return mins[bx + by * bw]; }
+	//[bx0,bx1]x[by0,by1]½
+	float min_depth(int bx0, int by0, int bx1, int by1) const;
+	//һ½
+	void update(int bx, int by);
 
-TGAColor getColorBilinear(TGAImage& texture, vec2 uv);
+	CullStats stats;  //draw()ļ
+
+private:
+	float* zbuffer;
+	int w, h, bw, bh;
+	std::vector<float> mins;
+};
+
+//ַ̬Ĺդ:ɫʵ,fragment()麯,
+//ShaderT::depth_onlyΪtrueʱdepth_span8,ֻд,ȫfragment()
+//8x8Χ,hizʱÿ½޳κ͵,ߺ
+//ֻդ[x0,x1]x[y0,y1]ڵ,дȵ.vװõ,remapPrimitive
+template <typename ShaderT>
+int rasterize(std::array<vec4, 3> v, ShaderT& shader, float* zbuffer, HierarchicalZ* hiz, CullStats* stats, TGAImage& image, int x0, int y0, int x1, int y1, const mat<3, 3>* remap = nullptr) {
+	TriangleSetup tri;
+	if (!tri.setup(v)) return 0;
+	//ҵboundingBox
+	auto [left, right, bottom, top] = boundingBox(v);
+	//ü[x0,x1]x[y0,y1]
+	left = std::max(left, (float)x0), bottom = std::max(bottom, (float)y0);
+	right = std::min(right, (float)x1), top = std::min(top, (float)y1);
+	if (left > right || bottom > top) return 0;
+	constexpr int B = HierarchicalZ::BLOCK;
+	const int bx0 = int(left) / B, bx1 = int(right) / B, by0 = int(bottom) / B, by1 = int(top) / B;
+	const float zmax = max_depth(v);
+	if (hiz) {
+		stats->triangles++;
+		if (zmax <= hiz->min_depth(bx0, by0, bx1, by1)) {
+			stats->triangles_culled++;
+			return 0;
+		}
+	}
+	const int width = image.width();
+	shader.primitive(v, remap);
+	//z
+	for (vec4& coord : v) coord.z = coord.z * coord.w;
+	const double vz[3] = { v[0].z, v[1].z, v[2].z };
+	const double k[3] = { tri.inv_area / vz[0], tri.inv_area / vz[1], tri.inv_area / vz[2] };
+	double e[3];
+	float z[8];
+	vec3 bary[8];
+	int written = 0;
+	//Ⱦ
+	for (int by = by0; by <= by1; by++) {
+		const int sy0 = std::max(by * B, int(bottom)), sy1 = std::min(by * B + B - 1, int(top));
+		for (int bx = bx0; bx <= bx1; bx++) {
+			const int sx0 = std::max(bx * B, int(left)), sx1 = std::min(bx * B + B - 1, int(right));
+			if (hiz) {
+				stats->blocks++;
+				if (zmax <= hiz->block_min(bx, by)) {
+					stats->blocks_culled++;
+					continue;
+				}
+			}
+			const int count = sx1 - sx0 + 1;
+			int block_written = 0;
+			for (int y = sy0; y <= sy1; y++) {
+				for (int i = 0; i < 3; i++) e[i] = tri.edge(i, sx0, y);
+				float* depth = zbuffer + sx0 + y * width;
+				if constexpr (ShaderT::depth_only) {
+					block_written += popcount8(depth_span8(tri, e, k, depth, count));
+				}
+				else {
+					int mask = span8(tri, e, vz, depth, count, z, bary);
+					for (int j = 0; mask; j++, mask >>= 1) {
+						if (!(mask & 1)) continue;
+						depth[j] = z[j];
+						block_written++;
+						//޶,麯;ShaderTShaderʱ
+						const vec3 b = remap ? *remap * bary[j] : bary[j];
+						std::optional<TGAColor> color;
+						if constexpr (std::is_same_v<ShaderT, Shader>) color = shader.fragment(b);
+						else color = shader.ShaderT::fragment(b);
+						if (color.has_value())
+							image.set(sx0 + j, y, *color);
+					}
+				}
+			}
+			if (hiz && block_written) hiz->update(bx, by);
+			written += block_written;
+		}
+	}
+	return written;
+}
+
+//draw()ͼԪװ,ٹդװ
+template <typename ShaderT>
+int draw(const std::array<vec4, 3>& v, ShaderT& shader, float* zbuffer, TGAImage& image, int x0, int y0, int x1, int y1) {
+	return for_each_primitive(v, shader.cull_face, image.width(), image.height(), nullptr, [&](const std::array<vec4, 3>& p, const mat<3, 3>* remap) {
+		return rasterize(p, shader, zbuffer, nullptr, nullptr, image, x0, y0, x1, y1, remap);
+	});
+}
+
+template <typename ShaderT>
+int draw(const std::array<vec4, 3>& v, ShaderT& shader, float* zbuffer, TGAImage& image) {
+	return draw(v, shader, zbuffer, image, 0, 0, image.width() - 1, image.height() - 1);
+}
+
+//ֲ޳,ۼӵstats.߳ʱ[x0,x1]x[y0,y1]ҪBLOCK
+template <typename ShaderT>
+int draw(const std::array<vec4, 3>& v, ShaderT& shader, HierarchicalZ& hiz, TGAImage& image, int x0, int y0, int x1, int y1, CullStats& stats) {
+	return for_each_primitive(v, shader.cull_face, image.width(), image.height(), &stats, [&](const std::array<vec4, 3>& p, const mat<3, 3>* remap) {
+		return rasterize(p, shader, hiz.data(), &hiz, &stats, image, x0, y0, x1, y1, remap);
+	});
+}
+
+template <typename ShaderT>
+int draw(const std::array<vec4, 3>& v, ShaderT& shader, HierarchicalZ& hiz, TGAImage& image) {
+	return draw(v, shader, hiz, image, 0, 0, image.width() - 1, image.height() - 1, hiz.stats);
+}
+
+//ز:ÿsamples,Ⱥɫһڴ,ͬһصĲڴ
+//(iصĵsi*samples+s),ɫһдʱֻһ.
+//λD3D2x/4x/8x׼ģʽ,֡ĩresolve()һΰѸصĲƽдͼ
+class MultisampleBuffer {
+public:
+	static constexpr int MAX_SAMPLES = 8;
+
+	//samplesΪ2,48,clear()
+	MultisampleBuffer(int width, int height, int samples = 4);
+
+	int width() const { return w; }
+	int height() const { return h; }
+	int samples() const { return n; }
+	//sλõƫ,λ1/16
+	int sample_x(int s) const { return pattern[s][0]; }
+	int sample_y(int s) const { return pattern[s][1]; }
+	float* depth(int x, int y) { return depths.data() + ((size_t)x + (size_t)y * w) * n; }
+	std::uint32_t* color(int x, int y) { return colors.data() + ((size_t)x + (size_t)y * w) * n; }
+
+	//ΪԶ,ɫú
+	void clear();
+	void resolve(TGAImage& image) const;
+
+	CullStats stats;  //draw()ͼԪװ
+
+private:
+	int w, h, n;
+	const signed char (*pattern)[2];
+	std::vector<float> depths;
+	std::vector<std::uint32_t> colors;  //BGRA
+};
+
+//زդ:ǺȰ,ÿֻҪвͨɫһ,дͨĲ.
+//ɫȡλ,λòʱȡһͨĲ(Ĳ,)
+template <typename ShaderT>
+int rasterize_msaa(std::array<vec4, 3> v, ShaderT& shader, MultisampleBuffer& ms, int x0, int y0, int x1, int y1, const mat<3, 3>* remap = nullptr) {
+	TriangleSetup tri;
+	if (!tri.setup(v)) return 0;
+	auto [left, right, bottom, top] = boundingBox(v);
+	//λò,Χһ
+	left = std::max(left - 1, (float)x0), bottom = std::max(bottom - 1, (float)y0);
+	right = std::min(right + 1, (float)x1), top = std::min(top + 1, (float)y1);
+	if (left > right || bottom > top) return 0;
+	shader.primitive(v, remap);
+	for (vec4& coord : v) coord.z = coord.z * coord.w;
+	const double k[3] = { tri.inv_area / v[0].z, tri.inv_area / v[1].z, tri.inv_area / v[2].z };
+	//1/16صƫƳ˵,ߺ־ȷ
+	constexpr double unit = TriangleSetup::SUBPIXEL / 16;
+	const int n = ms.samples();
+	double offset[3][MultisampleBuffer::MAX_SAMPLES], e_row[3], e[3], es[3], ef[3];
+	for (int i = 0; i < 3; i++) {
+		for (int s = 0; s < n; s++) offset[i][s] = tri.a[i] * unit * ms.sample_x(s) + tri.b[i] * unit * ms.sample_y(s);
+		e_row[i] = tri.edge(i, int(left), int(bottom));
+	}
+	int written = 0;
+	for (int y = int(bottom); y <= int(top); y++) {
+		for (int i = 0; i < 3; i++) e[i] = e_row[i];
+		for (int x = int(left); x <= int(right); x++) {
+			float* depth = ms.depth(x, y);
+			int mask = 0;
+			for (int s = 0; s < n; s++) {
+				for (int i = 0; i < 3; i++) es[i] = e[i] + offset[i][s];
+				if (!tri.inside(es)) continue;
+				float z = 1.f / (es[0] * k[0] + es[1] * k[1] + es[2] * k[2]);
+				if (depth[s] < z) {
+					depth[s] = z;
+					if (!mask) for (int i = 0; i < 3; i++) ef[i] = es[i];
+					mask |= 1 << s;
+				}
+			}
+			if (mask) {
+				const double* ec = tri.inside(e) ? e : ef;
+				dvec3 bary = { ec[0] * k[0], ec[1] * k[1], ec[2] * k[2] };
+				const double z = 1. / (bary[0] + bary[1] + bary[2]);
+				vec3 b(bary[0] * z, bary[1] * z, bary[2] * z);
+				if (remap) b = *remap * b;
+				std::optional<TGAColor> color;
+				if constexpr (std::is_same_v<ShaderT, Shader>) color = shader.fragment(b);
+				else color = shader.ShaderT::fragment(b);
+				if (color.has_value()) {
+					const std::uint32_t bgra = color->bgra[0] | color->bgra[1] << 8 | color->bgra[2] << 16 | 255u << 24;
+					std::uint32_t* samples = ms.color(x, y);
+					for (int s = 0; s < n; s++)
+						if (mask >> s & 1) samples[s] = bgra;
+				}
+				written += popcount8(mask);
+			}
+			for (int i = 0; i < 3; i++) e[i] += tri.step_x[i];
+		}
+		for (int i = 0; i < 3; i++) e_row[i] += tri.step_y[i];
+	}
+	return written;
+}
+
+//дȵĲ
+template <typename ShaderT>
+int draw(const std::array<vec4, 3>& v, ShaderT& shader, MultisampleBuffer& ms) {
+	return for_each_primitive(v, shader.cull_face, ms.width(), ms.height(), &ms.stats, [&](const std::array<vec4, 3>& p, const mat<3, 3>* remap) {
+		return rasterize_msaa(p, shader, ms, 0, 0, ms.width() - 1, ms.height() - 1, remap);
+	});
+}
+
+//麯汾,ɫֻʱ֪()ʱʹ
+void triangle(std::array<vec4,3> v,Shader& shader,float* zbuffer,TGAImage& image);
 
-vec3 rand_point_on_unit_sphere();
+//ֻդ[x0,x1]x[y0,y1]ڵ
+void triangle(std::array<vec4, 3> v, Shader& shader, float* zbuffer, TGAImage& image, int x0, int y0, int x1, int y1);
 
 #endif // !OUR_GL_H
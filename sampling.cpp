@@ -0,0 +1,127 @@
+#include "sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+bool parse_sequence(const std::string& name, SampleSequence& seq) {
+	for (SampleSequence s : { SampleSequence::Random, SampleSequence::Stratified, SampleSequence::Hammersley, SampleSequence::Sobol }) {
+		if (name == sequence_name(s)) {
+			seq = s;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* sequence_name(SampleSequence seq) {
+	switch (seq) {
+	case SampleSequence::Random: return "random";
+	case SampleSequence::Stratified: return "stratified";
+	case SampleSequence::Hammersley: return "hammersley";
+	case SampleSequence::Sobol: return "sobol";
+	}
+	return "";
+}
+
+//ȡ24λ,֤ϸС1
+static float to_unit(std::uint32_t bits) {
+	return (bits >> 8) * (1.f / (1 << 24));
+}
+
+static std::uint32_t reverse_bits(std::uint32_t v) {
+	v = (v << 16) | (v >> 16);
+	v = ((v & 0x00ff00ffu) << 8) | ((v & 0xff00ff00u) >> 8);
+	v = ((v & 0x0f0f0f0fu) << 4) | ((v & 0xf0f0f0f0u) >> 4);
+	v = ((v & 0x33333333u) << 2) | ((v & 0xccccccccu) >> 2);
+	v = ((v & 0x55555555u) << 1) | ((v & 0xaaaaaaaau) >> 1);
+	return v;
+}
+
+float radical_inverse(std::uint32_t i, std::uint32_t scramble) {
+	return to_unit(reverse_bits(i) ^ scramble);
+}
+
+vec2 hammersley(std::uint32_t i, std::uint32_t n, std::uint32_t scramble) {
+	return vec2((i + .5f) / n, radical_inverse(i, scramble));
+}
+
+vec2 sobol(std::uint32_t i, std::uint32_t scramble_x, std::uint32_t scramble_y) {
+	//һάķ1<<(31-k),λ;ڶάɱԭʽx+1õ:v[k]=v[k-1]^(v[k-1]>>1)
+	std::uint32_t y = 0;
+	for (std::uint32_t bits = i, v = 1u << 31; bits; bits >>= 1, v ^= v >> 1)
+		if (bits & 1) y ^= v;
+	return vec2(to_unit(reverse_bits(i) ^ scramble_x), to_unit(y ^ scramble_y));
+}
+
+vec2 stratified(std::uint32_t i, std::uint32_t n, unsigned seed) {
+	//ÿcols,һвʱĸӼӿ,и߰,ÿ1/n
+	const std::uint32_t cols = std::max(1u, (std::uint32_t)std::ceil(std::sqrt((double)n)));
+	const std::uint32_t start = i / cols * cols, k = std::min(cols, n - start);
+	std::seed_seq seq{ seed, i };
+	std::mt19937 rng(seq);
+	std::uniform_real_distribution<float> uniform(0.f, 1.f);
+	const float jx = uniform(rng), jy = uniform(rng);
+	return vec2((i - start + jx) / k, (start + k * jy) / n);
+}
+
+std::uint32_t hash_bits(std::uint32_t a, std::uint32_t b) {
+	//murmur3finalizer
+	std::uint32_t h = a * 0x9e3779b9u ^ b;
+	h ^= h >> 16, h *= 0x85ebca6bu;
+	h ^= h >> 13, h *= 0xc2b2ae35u;
+	return h ^ (h >> 16);
+}
+
+vec2 sample_2d(SampleSequence seq, std::uint32_t i, std::uint32_t n, unsigned seed) {
+	if (seq == SampleSequence::Random) {
+		std::seed_seq s{ seed, i };
+		std::mt19937 rng(s);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+		const float u = uniform(rng);
+		return vec2(u, uniform(rng));
+	}
+	//żźһ׶ҵ:żпʱԸԾ,
+	//ProgressiveMeanƲų(ֱӰżһSobol,ĵһάռ[0,.5)[.5,1))
+	const std::uint32_t half = i & 1, k = i >> 1, m = (n + 1 - half) / 2;
+	std::seed_seq s{ seed, half };
+	std::mt19937 rng(s);
+	const std::uint32_t sx = rng(), sy = rng();
+	if (seq == SampleSequence::Stratified) return stratified(k, m, sx);
+	if (seq == SampleSequence::Hammersley) return hammersley(k, m, sy);
+	return sobol(k, sx, sy);
+}
+
+vec3 uniform_hemisphere(vec2 u) {
+	constexpr float pi = 3.141592653f;
+	//yȷֲʱҲ(׵)
+	const float y = u.x, r = std::sqrt(std::max(0.f, 1 - y * y)), phi = 2 * pi * u.y;
+	return vec3(r * std::cos(phi), y, r * std::sin(phi));
+}
+
+ProgressiveMean::ProgressiveMean(std::size_t n) : sum{ std::vector<int>(n, 0), std::vector<int>(n, 0) } {}
+
+void ProgressiveMean::add(std::uint32_t index, const std::vector<int>& values, int samples) {
+	std::vector<int>& s = sum[index & 1];
+	for (std::size_t k = 0; k < s.size(); k++) s[k] += values[k];
+	count[index & 1] += samples;
+}
+
+int ProgressiveMean::mean(std::size_t k) const {
+	const int n = samples();
+	return n ? (sum[0][k] + sum[1][k] + n / 2) / n : 0;
+}
+
+double ProgressiveMean::error() const {
+	if (!count[0] || !count[1]) return std::numeric_limits<double>::infinity();
+	double acc = 0;
+	std::size_t m = 0;
+	for (std::size_t k = 0; k < sum[0].size(); k++) {
+		if (!sum[0][k] && !sum[1][k]) continue;
+		const double d = ((double)sum[0][k] / count[0] - (double)sum[1][k] / count[1]) / 2;
+		acc += d * d;
+		m++;
+	}
+	return m ? std::sqrt(acc / m) : 0;
+}
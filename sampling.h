@@ -0,0 +1,57 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+//[0,1)^2ϵ
+enum class SampleSequence {
+	Random,      //ÿһmt19937
+	Stratified,  //nһ,Ҫ֪n
+	Hammersley,  //((i+.5)/n,radical_inverse(i)),Ҫ֪n,ֻȡnʱž
+	Sobol        //ǰάSobol,ǰ׺,ʺ;ֹͣ
+};
+
+bool parse_sequence(const std::string& name, SampleSequence& seq);
+const char* sequence_name(SampleSequence seq);
+
+//λΪ[0,1)С,2Ϊ׵van der Corput
+float radical_inverse(std::uint32_t i, std::uint32_t scramble = 0);
+vec2 hammersley(std::uint32_t i, std::uint32_t n, std::uint32_t scramble = 0);
+//scrambleλ(ƽ),ֵͬõͬͬȵĵ㼯
+vec2 sobol(std::uint32_t i, std::uint32_t scramble_x = 0, std::uint32_t scramble_y = 0);
+vec2 stratified(std::uint32_t i, std::uint32_t n, unsigned seed);
+
+//a,bһȷֲ32λ,صĴλ
+std::uint32_t hash_bits(std::uint32_t a, std::uint32_t b);
+
+//seqĵi(0),n,seedʹҷʽ.
+//Random,żźֱȡ׶ҵ,ProgressiveMean
+vec2 sample_2d(SampleSequence seq, std::uint32_t i, std::uint32_t n, unsigned seed);
+//[0,1)^2ӳ䵽y>=0ĵλ
+vec3 uniform_hemisphere(vec2 u);
+
+//ۼ:żźۼ,ֵ֮һƵǰֵ,
+//,ͲеҲʵӳ
+class ProgressiveMean {
+public:
+	explicit ProgressiveMean(std::size_t n);
+
+	//valuesindexÿλϵȡֵ(ͬż֮,ʱsamplesΪ)
+	void add(std::uint32_t index, const std::vector<int>& values, int samples = 1);
+	int samples() const { return count[0] + count[1]; }
+	//kλõľֵ,
+	int mean(std::size_t k) const;
+	//붼ʱ,ֵλ(ֵ/2)ľ,λvaluesͬ;򷵻
+	double error() const;
+
+private:
+	std::vector<int> sum[2];
+	int count[2] = { 0, 0 };
+};
+
+#endif // !SAMPLING_H
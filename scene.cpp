@@ -0,0 +1,180 @@
+#include "scene.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+RenderJob::RenderJob() {
+	light.position = vec3(3, 3, 0);
+	light.direction = vec3(-2, 2, 2);
+	light.intensity = 1;
+	light.ambient = 0.1 * vec3(255, 255, 255);
+	light.diffuse = vec3(255, 255, 255);
+	light.specular = vec3(255, 255, 255);
+	material.ambient = material.diffuse = material.specular = vec3(249, 210, 228);
+	material.shininess = 32;
+}
+
+bool RenderJob::known_mode(const std::string& mode) {
+	for (const char* m : { "shadow", "texture", "phong", "normal", "msaa", "bilinear", "trilinear", "occlusion", "occlusion_rt" })
+		if (mode == m) return true;
+	return false;
+}
+
+//ֶʱͬapply_mode_defaults
+RenderJob RenderJob::defaults(const std::string& mode) {
+	RenderJob job;
+	job.mode = mode;
+	if (mode == "shadow") job.material.ambient = job.material.diffuse = job.material.specular = vec3(255, 231, 111);
+	if (mode == "texture" || mode == "bilinear" || mode == "trilinear") job.eye = vec3(2, 0, 3);
+	//úС,൱ڴԶ۲,СʱҪmip
+	if (mode == "trilinear") job.zoom = 1.f / 8;
+	if (mode == "phong" || mode == "normal" || mode == "msaa") job.yaw = 45;
+	if (mode == "occlusion" || mode == "occlusion_rt") job.output = "total_occl.tga";
+	return job;
+}
+
+//ֻһ%d,Դ0Ϳ,%04d
+static bool valid_pattern(const std::string& s) {
+	int count = 0;
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i] != '%') continue;
+		size_t j = i + 1;
+		while (j < s.size() && (s[j] >= '0' && s[j] <= '9')) j++;
+		if (j >= s.size() || s[j] != 'd') return false;
+		count++;
+		i = j;
+	}
+	return count <= 1;
+}
+
+//ļﻻmodeʱ,һȡģʽĬֵ,ļʽֶαֲ
+static void apply_mode_defaults(RenderJob& job, const std::set<std::string>& given) {
+	const RenderJob d = RenderJob::defaults(job.mode);
+	auto keep = [&](const char* cmd) { return given.count(cmd) > 0; };
+	if (!keep("eye")) job.eye = d.eye;
+	if (!keep("zoom")) job.zoom = d.zoom;
+	if (!keep("yaw")) job.yaw = d.yaw;
+	if (!keep("output")) job.output = d.output;
+	if (!keep("material") && !keep("material_ambient")) job.material.ambient = d.material.ambient;
+	if (!keep("material") && !keep("material_diffuse")) job.material.diffuse = d.material.diffuse;
+	if (!keep("material") && !keep("material_specular")) job.material.specular = d.material.specular;
+}
+
+static std::string output_name(const std::string& pattern, int index) {
+	if (pattern.find('%') == std::string::npos) return pattern;
+	std::vector<char> buf(pattern.size() + 32);
+	std::snprintf(buf.data(), buf.size(), pattern.c_str(), index);
+	return buf.data();
+}
+
+bool load_scene(const std::string& filename, std::vector<RenderJob>& jobs) {
+	std::ifstream in(filename);
+	if (!in) {
+		std::cerr << "can't open scene file " << filename << std::endl;
+		return false;
+	}
+	RenderJob cur;
+	std::set<std::string> given;  //ļֹ
+	std::string line;
+	int lineno = 0;
+	auto fail = [&](const std::string& msg) {
+		std::cerr << filename << ":" << lineno << ": " << msg << std::endl;
+		return false;
+	};
+	auto emit = [&](const RenderJob& job) {
+		jobs.push_back(job);
+		jobs.back().output = output_name(job.output, (int)jobs.size() - 1);
+	};
+	while (std::getline(in, line)) {
+		lineno++;
+		line = line.substr(0, line.find('#'));
+		std::istringstream ss(line);
+		std::string cmd;
+		if (!(ss >> cmd)) continue;
+
+		auto read_vec3 = [&](vec3& v) { return bool(ss >> v.x >> v.y >> v.z); };
+		bool ok = true;
+		if (cmd == "size") ok = ss >> cur.width >> cur.height && cur.width > 0 && cur.height > 0;
+		else if (cmd == "mode") {
+			ok = ss >> cur.mode && RenderJob::known_mode(cur.mode);
+			if (ok) apply_mode_defaults(cur, given);
+		}
+		else if (cmd == "model") {
+			std::string m;
+			ok = bool(ss >> m);
+			if (ok) cur.models.push_back(m);
+		}
+		else if (cmd == "clear_models") cur.models.clear();
+		else if (cmd == "eye") ok = read_vec3(cur.eye);
+		else if (cmd == "center") ok = read_vec3(cur.center);
+		else if (cmd == "up") ok = read_vec3(cur.up);
+		else if (cmd == "yaw") ok = bool(ss >> cur.yaw);
+		else if (cmd == "zoom") ok = ss >> cur.zoom && cur.zoom > 0 && cur.zoom <= 1;
+		else if (cmd == "cull") {
+			std::string c;
+			ok = bool(ss >> c);
+			if (c == "back") cur.cull = CullFace::Back;
+			else if (c == "front") cur.cull = CullFace::Front;
+			else if (c == "none") cur.cull = CullFace::None;
+			else ok = false;
+		}
+		else if (cmd == "samples") ok = ss >> cur.samples && (cur.samples == 2 || cur.samples == 4 || cur.samples == 8);
+		else if (cmd == "iterations") ok = ss >> cur.iterations && cur.iterations > 0;
+		else if (cmd == "seed") ok = bool(ss >> cur.seed);
+		else if (cmd == "sampler") {
+			std::string name;
+			ok = ss >> name && parse_sequence(name, cur.sampler);
+		}
+		else if (cmd == "rays") ok = ss >> cur.rays && cur.rays > 0;
+		else if (cmd == "tolerance") ok = ss >> cur.tolerance && cur.tolerance >= 0;
+		else if (cmd == "bake") {
+			std::string b;
+			ok = bool(ss >> b);
+			if (b == "texture") cur.texture_space = true;
+			else if (b == "screen") cur.texture_space = false;
+			else ok = false;
+		}
+		else if (cmd == "light_position") ok = read_vec3(cur.light.position);
+		else if (cmd == "light_direction") ok = read_vec3(cur.light.direction);
+		else if (cmd == "light_ambient") ok = read_vec3(cur.light.ambient);
+		else if (cmd == "light_diffuse") ok = read_vec3(cur.light.diffuse);
+		else if (cmd == "light_specular") ok = read_vec3(cur.light.specular);
+		else if (cmd == "material") {
+			ok = read_vec3(cur.material.ambient);
+			cur.material.diffuse = cur.material.specular = cur.material.ambient;
+		}
+		else if (cmd == "material_ambient") ok = read_vec3(cur.material.ambient);
+		else if (cmd == "material_diffuse") ok = read_vec3(cur.material.diffuse);
+		else if (cmd == "material_specular") ok = read_vec3(cur.material.specular);
+		else if (cmd == "shininess") ok = bool(ss >> cur.material.shininess);
+		else if (cmd == "occlusion_map") ok = bool(ss >> cur.occlusion_map);
+		else if (cmd == "output") ok = ss >> cur.output && valid_pattern(cur.output);
+		else if (cmd == "render" || cmd == "turntable") {
+			int n = 1;
+			if (cmd == "turntable") ok = ss >> n && n > 0;
+			if (ok && cur.models.empty()) return fail("no model given before " + cmd);
+			//ӽдͬһļֻһ
+			if (ok && n > 1 && cur.output.find('%') == std::string::npos) return fail("turntable needs a %d in output " + cur.output);
+			//߶Ⱥ͵centerˮƽ,ӵǰλǿʼȷһȦ
+			constexpr float pi = 3.141592653f;
+			const vec3 offset = cur.eye - cur.center;
+			const float r = std::sqrt(offset.x * offset.x + offset.z * offset.z), a0 = std::atan2(offset.x, offset.z);
+			for (int k = 0; ok && k < n; k++) {
+				RenderJob job = cur;
+				if (k) {
+					const float a = a0 + 2 * pi * k / n;
+					job.eye = cur.center + vec3(r * std::sin(a), offset.y, r * std::cos(a));
+				}
+				emit(job);
+			}
+		}
+		else return fail("unknown command " + cmd);
+		if (!ok) return fail("bad arguments for " + cmd);
+		given.insert(cmd);
+	}
+	return true;
+}
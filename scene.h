@@ -0,0 +1,55 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "our_gl.h"
+#include "sampling.h"
+
+//һȾ:ģʽ,ֱ,,Դ,,ģͺļ,ȡԭڵȫ
+struct RenderJob {
+	std::string mode = "phong";  //shadow texture phong normal msaa bilinear trilinear occlusion occlusion_rt
+	int width = 800, height = 800;
+	vec3 eye = { 0, 0, 3 }, center = { 0, 0, 0 }, up = { 0, 1, 0 };
+	float yaw = 0;               //ģyתĽǶ
+	float zoom = .75f;           //ӿռı,
+	CullFace cull = CullFace::Back;
+	Light light;
+	Material material;
+	std::vector<std::string> models;
+	std::string output = "output.tga";
+	int samples = 4;             //msaaĲ
+	int iterations = 30;         //occlusionĵ
+	unsigned seed = 0;           //occlusionշ
+	SampleSequence sampler = SampleSequence::Sobol;  //occlusionշ
+	float tolerance = 0;         //occlusionƵǰͣ,λǻҶȼ,0ʾiterations
+	int rays = 64;               //occlusion_rtÿصĹ
+	bool texture_space = true;   //occlusionռغ決,falseʱԭĻռƬԪдͼ
+	std::string occlusion_map = "occl.tga";
+
+	RenderJob();
+	//ģʽԭдrender_*Ĭֵ
+	static RenderJob defaults(const std::string& mode);
+	static bool known_mode(const std::string& mode);
+};
+
+//ļ,ÿһ,#֮ע.һֱֵĵ,render/turntableǰ:
+//  size 800 800              mode phong               model obj/a.obj    clear_models
+//  eye 0 0 3                 center 0 0 0             up 0 1 0
+//  yaw 45                    zoom 0.75                samples 4          iterations 30
+//  cull back|front|none      񲻷ջһʱnone
+//  light_position|light_direction|light_ambient|light_diffuse|light_specular x y z
+//  material r g b            material_ambient|material_diffuse|material_specular r g b
+//  shininess 32              occlusion_map occl.tga   seed 0             rays 64
+//  sampler sobol|hammersley|stratified|random          tolerance 1.5
+//  bake texture|screen       occlusionռ仹Ļռ決
+//  output out/view_%04d.tga  %d(ɴ)滻
+//  render                    һ
+//  turntable 36              centerˮƽתһȦ,36,output%d
+//modeһϸģʽĬeye/zoom/yaw/material/output,֮ǰʽĲӰ
+//ʱstd::cerrϱļк,false
+bool load_scene(const std::string& filename, std::vector<RenderJob>& jobs);
+
+#endif // !SCENE_H
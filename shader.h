@@ -2,6 +2,7 @@
 #define SHADER_H
 
 #include "our_gl.h"
+#include "texture.h"
 #include "geometry.h"
 
 #include <memory>
@@ -9,21 +10,33 @@
 //߿ӻ
 class NormalShader :public Shader {
 public:
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
 	std::array<vec3,3> normals;
 	std::array<vec4,3> coords;
 
+	//TileRasterizerαĲ,״̬ÿbindֻһ
+	struct Varyings {
+		std::array<vec3, 3> normals;
+		std::array<vec4, 3> coords;
+	};
+	Varyings varyings() const { return { normals, coords }; }
+	void set_varyings(const Varyings& v) { normals = v.normals, coords = v.coords; }
+
 	std::array<vec4,3> vertex(std::array<vec3,3> world_coords){
 		for (int i = 0; i < 3; i++) {
-			normals[i] = model.invert_transpose().get_minor(3, 3) * normals[i];
-			coords[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i]));
+			normals[i] = uniforms.normal_matrix() * normals[i];
+			coords[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i]));
 			coords[i].z = coords[i].w * coords[i].z;
 		}
 		return coords;
 	} 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> /*world_coords*/, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) {
+			normals[i] = uniforms.normal_matrix() * normals[i];
+			coords[i] = screen_coords[i];
+			coords[i].z = coords[i].w * coords[i].z;
+		}
+		return coords;
+	}
 	std::optional<TGAColor> fragment(vec3 bar){
 
 		vec3 normal = normals[0] * bar[0] + normals[1] * bar[1] + normals[2] * bar[2];
@@ -37,27 +50,38 @@ public:
 //Ϲ(ƽй)
 class PhoneLightShader : public Shader {
 public:
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
 	vec3 eye;
 	std::array<vec3, 3> normals;
 	std::array<vec4, 3> coords;
 
 	Material material;
 	Light light;
+
+	struct Varyings {
+		std::array<vec3, 3> normals;
+		std::array<vec4, 3> coords;
+	};
+	Varyings varyings() const { return { normals, coords }; }
+	void set_varyings(const Varyings& v) { normals = v.normals, coords = v.coords; }
 	
 	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
 		std::array<vec4, 3> res;
 		for (int i = 0; i < 3; i++) {
-			normals[i] =  model.invert_transpose().get_minor(3, 3) * normals[i];
-			coords[i] = model * embed<4>(world_coords[i],1);
-			res[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i],1));
+			normals[i] =  uniforms.normal_matrix() * normals[i];
+			coords[i] = uniforms.model() * embed<4>(world_coords[i],1);
+			res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i],1));
 		}
 		return res;
 	}
 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) {
+			normals[i] = uniforms.normal_matrix() * normals[i];
+			coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+		}
+		return screen_coords;
+	}
+
 	std::optional<TGAColor> fragment(vec3 bar) {
 		vec3 normal = (normals[0] * bar[0] + normals[1] * bar[1] + normals[2] * bar[2]).normalize();
 		vec3 ambient, diffuse, specular;
@@ -71,15 +95,15 @@ public:
 		//
 		ambient = absorb(material.ambient, light.ambient);
 		//
-		light.direction = light.direction.normalize();
-		diff = std::max(light.direction * normal, double(0));
+		vec3 light_dir = vec3(light.direction).normalize();
+		diff = std::max(light_dir * normal, 0.f);
 		diffuse = diff * absorb(material.diffuse, light.diffuse);
 		//
 		vec3 coord = proj<3>(coords[0] * bar[0] + coords[1] * bar[1] + coords[2] * bar[2]);
 		vec3 eye_direction = (eye - coord).normalize();
-		vec3 mid_vector = (eye_direction + light.direction) / 2;
-		vec3 r = (normal * (normal * light.direction * 2.f) - light.direction).normalize();   // reflected light
-		spec = std::max(r * eye_direction, double(0));
+		vec3 mid_vector = (eye_direction + light_dir) / 2;
+		vec3 r = (normal * (normal * light_dir * 2.f) - light_dir).normalize();   // reflected light
+		spec = std::max(r * eye_direction, 0.f);
 		spec = std::pow(spec, material.shininess);
 		specular = absorb(material.specular, light.specular) * spec ;
 
@@ -93,27 +117,28 @@ public:
 //
 class TextureShader:public Shader {
 public:
-	TGAImage texture;
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
+	Texture texture;
 	std::array<vec4, 3> coords;
 	std::array<vec2, 3> uvs;
 
-	TGAColor sample2D(const TGAImage& img, vec2& uvf) {
-		return img.get(uvf[0] * img.width(), uvf[1] * img.height());
+	TGAColor sample2D(const Texture& tex, vec2& uvf) {
+		return tex.get(uvf[0] * tex.width(), uvf[1] * tex.height());
 	}
 
 	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
 		std::array<vec4, 3> res;
 		for (int i = 0; i < 3; i++) {
-			coords[i] = model * embed<4>(world_coords[i], 1);
-			res[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i], 1));
+			coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+			res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i], 1));
 		}
 		return res;
 	}
 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+		return screen_coords;
+	}
+
 	std::optional<TGAColor> fragment(vec3 bar) {
 		vec2 uv = uvs[0] * bar[0] + uvs[1] * bar[1] + uvs[2] * bar[2];
 		return sample2D(texture, uv);
@@ -124,17 +149,22 @@ public:
 //ͼ
 class DeepthShader :public Shader {
 public:
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
+	static constexpr bool depth_only = true;
+
+	struct Varyings {};
+	Varyings varyings() const { return {}; }
+	void set_varyings(const Varyings&) {}
 
 	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
 		std::array<vec4, 3> res;
-		for (int i = 0; i < 3; i++) res[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i], 1));
+		for (int i = 0; i < 3; i++) res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i], 1));
 		return res;
 	}
 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> /*world_coords*/, std::array<vec4, 3> screen_coords) {
+		return screen_coords;
+	}
+
 	std::optional<TGAColor> fragment(vec3 bar) {
 		return std::nullopt;
 	}
@@ -146,11 +176,6 @@ class ShadowShader :public Shader {
 private:
 	std::array<vec4, 3> deepth_coords;
 public:
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
-	mat<4, 4> deepth_matrix;
 	vec3 eye;
 	std::array<vec3, 3> normals;
 	std::array<vec4, 3> coords;
@@ -160,18 +185,35 @@ public:
 	Material material;
 	Light light;
 
+	struct Varyings {
+		std::array<vec3, 3> normals;
+		std::array<vec4, 3> coords, deepth_coords;
+	};
+	Varyings varyings() const { return { normals, coords, deepth_coords }; }
+	void set_varyings(const Varyings& v) { normals = v.normals, coords = v.coords, deepth_coords = v.deepth_coords; }
+
 	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
 		std::array<vec4, 3> res;
 		for (int i = 0; i < 3; i++) {
-			normals[i] = model.invert_transpose().get_minor(3, 3) * normals[i];
-			coords[i] = model * embed<4>(world_coords[i], 1);
-			deepth_coords[i] = Homogenization(deepth_matrix * embed<4>(world_coords[i], 1));
+			normals[i] = uniforms.normal_matrix() * normals[i];
+			coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+			deepth_coords[i] = Homogenization(uniforms.light_space() * embed<4>(world_coords[i], 1));
 			deepth_coords[i].z = deepth_coords[i].z * deepth_coords[i].w;
-			res[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i], 1));
+			res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i], 1));
 		}
 		return res;
 	}
 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) {
+			normals[i] = uniforms.normal_matrix() * normals[i];
+			coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+			deepth_coords[i] = Homogenization(uniforms.light_space() * embed<4>(world_coords[i], 1));
+			deepth_coords[i].z = deepth_coords[i].z * deepth_coords[i].w;
+		}
+		return screen_coords;
+	}
+
 	std::optional<TGAColor> fragment(vec3 bar) {
 		vec3 normal = (normals[0] * bar[0] + normals[1] * bar[1] + normals[2] * bar[2]).normalize();
 		vec3 ambient, diffuse, specular;
@@ -192,15 +234,15 @@ public:
 		//
 		ambient = absorb(material.ambient, light.ambient);
 		//
-		light.direction = (light.position - coord).normalize();
-		diff = std::max(light.direction * normal, double(0));
+		vec3 light_dir = (light.position - coord).normalize();
+		diff = std::max(light_dir * normal, 0.f);
 		diffuse = diff * absorb(material.diffuse, light.diffuse);
 		//
 		vec3 eye_direction = (eye - coord).normalize();
-		vec3 mid_vector = (eye_direction + light.direction) / 2;
-		vec3 r = (normal * (normal * light.direction * 2.f) - light.direction).normalize();   // reflected light
-		//spec = std::max(mid_vector.normalize() * normal, double(0));
-		spec = std::max(r * eye_direction, double(0));
+		vec3 mid_vector = (eye_direction + light_dir) / 2;
+		vec3 r = (normal * (normal * light_dir * 2.f) - light_dir).normalize();   // reflected light
+		//spec = std::max(mid_vector.normalize() * normal, 0.f);
+		spec = std::max(r * eye_direction, 0.f);
 		spec = std::pow(spec, material.shininess);
 		specular = absorb(material.specular, light.specular) * spec;
 
@@ -215,45 +257,100 @@ public:
 //˫Բֵ
 class BilinearTextureShader:public Shader {
 public:
-	TGAImage texture;
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
+	Texture texture;
 	std::array<vec4, 3> coords;
 	std::array<vec2, 3> uvs;
 
-	TGAColor sample2D(TGAImage& img, vec2& uvf) {
-		//return img.get(uvf[0] * img.width(), uvf[1] * img.height());
-		return getColorBilinear(img, uvf);
+	TGAColor sample2D(const Texture& tex, vec2& uvf) {
+		return tex.bilinear(uvf);
 	}
 
 	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
 		std::array<vec4, 3> res;
 		for (int i = 0; i < 3; i++) {
-			coords[i] = model * embed<4>(world_coords[i], 1);
-			res[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i], 1));
+			coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+			res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i], 1));
 		}
 		return res;
 	}
 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) coords[i] = uniforms.model() * embed<4>(world_coords[i], 1);
+		return screen_coords;
+	}
+
 	std::optional<TGAColor> fragment(vec3 bar) {
 		vec2 uv = uvs[0] * bar[0] + uvs[1] * bar[1] + uvs[2] * bar[2];
 		return sample2D(texture, uv);
 	}
 };
 
+//Բֵ:loduvĻռĵ,ԶδӽСmip
+class TrilinearTextureShader :public Shader {
+public:
+	Texture texture;
+	std::array<vec2, 3> uvs;
+
+	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
+		std::array<vec4, 3> res;
+		for (int i = 0; i < 3; i++) res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i], 1));
+		for (int i = 0; i < 3; i++) vz[i] = res[i].z * res[i].w;
+		return res;
+	}
+
+	std::array<vec4, 3> vertex(std::array<vec3, 3> /*world_coords*/, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) vz[i] = screen_coords[i].z * screen_coords[i].w;
+		return screen_coords;
+	}
+
+	//ü:ƽʱԭεĻӽ,ֲ.
+	//ͬһƽϵ͸ӳ䴦ͬ,ĸdA,dBfragment()A,Bһ
+	void primitive(const std::array<vec4, 3>& v, const mat<3, 3>* remap) {
+		std::array<vec2, 3> uv = uvs;
+		if (remap)
+			for (int j = 0; j < 3; j++) uv[j] = uvs[0] * (*remap)[0][j] + uvs[1] * (*remap)[1][j] + uvs[2] * (*remap)[2][j];
+		setup_derivatives(v, uv);
+	}
+
+	std::optional<TGAColor> fragment(vec3 bar) {
+		vec2 uv = uvs[0] * bar[0] + uvs[1] * bar[1] + uvs[2] * bar[2];
+		//uv=A/B,B=1/sum(bar_i*vz_i)
+		float b = 1.f / (bar[0] * vz[0] + bar[1] * vz[1] + bar[2] * vz[2]);
+		vec2 duv_dx = (a_dx - uv * b_dx) / b, duv_dy = (a_dy - uv * b_dy) / b;
+		return texture.trilinear(uv, duv_dx, duv_dy);
+	}
+
+private:
+	//դvz=z*w͸ӽ,uv=A/B,A=sum(s_i*uv_i/vz_i),B=sum(s_i/vz_i)ĻsԱ仯,
+	//d(uv)/dx=(dA/dx-uv*dB/dx)/B,൱2x2ؿϵĲ,ÿֻһdA,dB
+	vec3 vz;
+	vec2 a_dx, a_dy;
+	float b_dx = 0, b_dy = 0;
+
+	//vĻϵ,uv
+	void setup_derivatives(const std::array<vec4, 3>& v, const std::array<vec2, 3>& uv) {
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		a_dx = a_dy = vec2(0, 0);
+		b_dx = b_dy = 0;
+		if (area == 0) return;
+		for (int i = 0; i < 3; i++) {
+			const vec4& pj = v[(i + 1) % 3], & pk = v[(i + 2) % 3];
+			const float vzi = v[i].z * v[i].w;
+			float ds_dx = (pj.y - pk.y) / area, ds_dy = (pk.x - pj.x) / area;
+			a_dx = a_dx + uv[i] * (ds_dx / vzi);
+			a_dy = a_dy + uv[i] * (ds_dy / vzi);
+			b_dx += ds_dx / vzi;
+			b_dy += ds_dy / vzi;
+		}
+	}
+};
+
 //ȫֹ
 class OcclusionShader :public Shader {
 public:
 private:
 	std::array<vec4, 3> deepth_coords;
 public:
-	mat<4, 4> projection;
-	mat<4, 4> viewport;
-	mat<4, 4> lookat;
-	mat<4, 4> model;
-	mat<4, 4> deepth_matrix;
 	std::array<vec2, 3> uvs;
 	float* shadow_buffer;
 	vec2 dim;
@@ -262,13 +359,21 @@ public:
 	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords) {
 		std::array<vec4, 3> res;
 		for (int i = 0; i < 3; i++) {
-			deepth_coords[i] = Homogenization(deepth_matrix * embed<4>(world_coords[i], 1));
+			deepth_coords[i] = Homogenization(uniforms.light_space() * embed<4>(world_coords[i], 1));
 			deepth_coords[i].z = deepth_coords[i].z * deepth_coords[i].w;
-			res[i] = Homogenization(viewport * projection * lookat * model * embed<4>(world_coords[i], 1));
+			res[i] = Homogenization(uniforms.mvp() * embed<4>(world_coords[i], 1));
 		}
 		return res;
 	}
 
+	std::array<vec4, 3> vertex(std::array<vec3, 3> world_coords, std::array<vec4, 3> screen_coords) {
+		for (int i = 0; i < 3; i++) {
+			deepth_coords[i] = Homogenization(uniforms.light_space() * embed<4>(world_coords[i], 1));
+			deepth_coords[i].z = deepth_coords[i].z * deepth_coords[i].w;
+		}
+		return screen_coords;
+	}
+
 	std::optional<TGAColor> fragment(vec3 bar) {
 		vec2 uv = uvs[0] * bar[0] + uvs[1] * bar[1] + uvs[2] * bar[2];
 		float z_interpolated = deepth_coords[0].z * bar[0] + deepth_coords[1].z * bar[1] + deepth_coords[2].z * bar[2];
@@ -281,6 +386,13 @@ public:
 		}
 		return std::nullopt;
 	}
+
+	//ռ決:ģͿռĵpǷ񱻹յ,ȱȽfragmentͬ
+	bool lit(vec3 p) const {
+		const vec4 d = Homogenization(uniforms.light_space() * embed<4>(p, 1));
+		const int idx = int(d.x) + int(d.y) * int(dim.x);
+		return idx >= 0 && idx <= dim.x * dim.y - 1 && shadow_buffer[idx] < d.z * d.w + 0.08;
+	}
 	
 };
 
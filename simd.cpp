@@ -0,0 +1,25 @@
+#include "simd.h"
+
+#if defined(USE_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static bool detect_avx2() {
+#if !defined(USE_X86_SIMD)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool cpu_has_avx2() {
+	static const bool has = detect_avx2();
+	return has;
+}
@@ -0,0 +1,20 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//NO_SIMDǿֻñ·
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(NO_SIMD)
+#define USE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+//ֻAVX2ָ,뱣ָֻ,ʱپǷ
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+//ʱCPU(Լϵͳ)Ƿ֧AVX2
+bool cpu_has_avx2();
+
+#endif // !SIMD_H
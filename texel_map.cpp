@@ -0,0 +1,132 @@
+#include "texel_map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+std::ostream& operator<<(std::ostream& out, const TexelMapStats& s) {
+	out << s.covered << " texels covered (" << s.dilated << " only partly, " << s.contested << " by several triangles), "
+		<< s.triangles << " triangles, built in " << s.build_ms << " ms";
+	return out;
+}
+
+TexelMap::TexelMap(int width, int height) : w(width), h(height), texels((size_t)width * height) {}
+
+void TexelMap::add(const Model& model, const mat<4, 4>& transform) {
+	for (int iface = 0; iface < model.nfaces(); iface++) {
+		Triangle t;
+		for (int k = 0; k < 3; k++) {
+			t.v[k] = proj<3>(transform * embed<4>(model.vert(iface, k), 1.f));
+			const vec2 uv = model.uv(iface, k);
+			t.t[k] = vec2(uv.x * w, uv.y * h);
+		}
+		t.n = cross(t.v[1] - t.v[0], t.v[2] - t.v[0]);
+		tris.push_back(t);
+	}
+}
+
+//tb[j]=c[j]+gx[j]*x+gy[j]*y,jı(j+1,j+2)
+struct TexelMap::Edges {
+	float c[3], gx[3], gy[3], inv_len[3];
+
+	explicit Edges(const vec2* t) {
+		const float area = (t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[2].x - t[0].x) * (t[1].y - t[0].y);
+		for (int j = 0; j < 3; j++) {
+			const vec2 a = t[(j + 1) % 3], b = t[(j + 2) % 3];
+			gx[j] = -(b.y - a.y) / area, gy[j] = (b.x - a.x) / area;
+			c[j] = -(gx[j] * a.x + gy[j] * a.y);
+			inv_len[j] = 1 / std::sqrt(gx[j] * gx[j] + gy[j] * gy[j]);
+		}
+	}
+	float bary(int j, float x, float y) const {
+		return c[j] + gx[j] * x + gy[j] * y;
+	}
+};
+
+void TexelMap::build(ThreadPool& pool) {
+	const auto t0 = std::chrono::steady_clock::now();
+	st = TexelMapStats();
+	st.triangles = (int)tris.size();
+	std::fill(texels.begin(), texels.end(), Texel());
+
+	//طΧ,UV򼸺Ϊ0β
+	const int tiles_x = (w + TILE - 1) / TILE, tiles_y = (h + TILE - 1) / TILE;
+	std::vector<std::vector<int>> bins(tiles_x * tiles_y);
+	for (int i = 0; i < (int)tris.size(); i++) {
+		const Triangle& t = tris[i];
+		const float area = (t.t[1].x - t.t[0].x) * (t.t[2].y - t.t[0].y) - (t.t[2].x - t.t[0].x) * (t.t[1].y - t.t[0].y);
+		if (area == 0 || t.n.norm2() == 0) continue;
+		//xռ[x,x+1],ֻ߽Ĳ
+		const int x0 = std::max(0, (int)std::floor(std::min({ t.t[0].x, t.t[1].x, t.t[2].x })));
+		const int x1 = std::min(w - 1, (int)std::ceil(std::max({ t.t[0].x, t.t[1].x, t.t[2].x })) - 1);
+		const int y0 = std::max(0, (int)std::floor(std::min({ t.t[0].y, t.t[1].y, t.t[2].y })));
+		const int y1 = std::min(h - 1, (int)std::ceil(std::max({ t.t[0].y, t.t[1].y, t.t[2].y })) - 1);
+		for (int ty = y0 / TILE; ty <= y1 / TILE && x0 <= x1; ty++)
+			for (int tx = x0 / TILE; tx <= x1 / TILE; tx++) bins[tx + ty * tiles_x].push_back(i);
+	}
+
+	std::vector<TexelMapStats> tile_stats(bins.size());
+	pool.parallel_for((int)bins.size(), [&](int tile) {
+		const int bx0 = tile % tiles_x * TILE, by0 = tile / tiles_x * TILE;
+		const int bx1 = std::min(w, bx0 + TILE) - 1, by1 = std::min(h, by0 + TILE) - 1;
+		//score:ĵε(ڲʱΪ0),ԽԽ;hits:ѹص,2Ϊֹ
+		float score[TILE * TILE];
+		int owner[TILE * TILE];
+		unsigned char hits[TILE * TILE] = {};
+		std::fill(score, score + TILE * TILE, -std::numeric_limits<float>::max());
+		std::fill(owner, owner + TILE * TILE, -1);
+		//±С,ͬʱӵĸȼӵ,Ͱ˳һ
+		for (int i : bins[tile]) {
+			const Triangle& t = tris[i];
+			const Edges e(t.t);
+			const int x0 = std::max(bx0, (int)std::floor(std::min({ t.t[0].x, t.t[1].x, t.t[2].x })));
+			const int x1 = std::min(bx1, (int)std::ceil(std::max({ t.t[0].x, t.t[1].x, t.t[2].x })) - 1);
+			const int y0 = std::max(by0, (int)std::floor(std::min({ t.t[0].y, t.t[1].y, t.t[2].y })));
+			const int y1 = std::min(by1, (int)std::ceil(std::max({ t.t[0].y, t.t[1].y, t.t[2].y })) - 1);
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					//طֵ = Ĵֵ + سݶȵľֵ;
+					//߸ԳֻǱҪ,ܶ㼸,ǵĵᱻл
+					float d = 0;
+					bool overlap = true;
+					for (int j = 0; j < 3 && overlap; j++) {
+						const float b = e.bary(j, x + .5f, y + .5f);
+						overlap = b + .5f * (std::abs(e.gx[j]) + std::abs(e.gy[j])) >= 0;
+						d = std::min(d, b * e.inv_len[j]);
+					}
+					if (!overlap) continue;
+					const int k = (x - bx0) + (y - by0) * TILE;
+					hits[k] = (unsigned char)std::min(2, hits[k] + 1);
+					if (d >= score[k]) score[k] = d, owner[k] = i;
+				}
+			}
+		}
+
+		TexelMapStats& s = tile_stats[tile];
+		for (int y = by0; y <= by1; y++) {
+			for (int x = bx0; x <= bx1; x++) {
+				const int k = (x - bx0) + (y - by0) * TILE;
+				if (owner[k] < 0) continue;
+				const Triangle& t = tris[owner[k]];
+				const Edges e(t.t);
+				//ʱѸе0ٹһ,õϿĵĵ
+				float b[3], sum = 0;
+				for (int j = 0; j < 3; j++) sum += b[j] = std::max(0.f, e.bary(j, x + .5f, y + .5f));
+				Texel& texel = texels[x + y * w];
+				texel.p = (t.v[0] * b[0] + t.v[1] * b[1] + t.v[2] * b[2]) / sum;
+				texel.n = t.n / t.n.norm();
+				texel.face = owner[k];
+				s.covered++;
+				if (score[k] < 0) s.dilated++;
+				if (hits[k] > 1) s.contested++;
+			}
+		}
+	});
+	for (const TexelMapStats& s : tile_stats) {
+		st.covered += s.covered;
+		st.dilated += s.dilated;
+		st.contested += s.contested;
+	}
+	st.build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
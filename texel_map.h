@@ -0,0 +1,57 @@
+#ifndef TEXEL_MAP_H
+#define TEXEL_MAP_H
+
+#include <ostream>
+#include <vector>
+
+#include "geometry.h"
+#include "model.h"
+#include "thread_pool.h"
+
+struct TexelMapStats {
+	int triangles = 0;
+	int covered = 0;    //йε
+	int dilated = 0;    //Ĳκ,ֻǱѹһֵ(UVԵ)
+	int contested = 0;  //вֹһѹ
+	double build_ms = 0;
+};
+std::ostream& operator<<(std::ostream& out, const TexelMapStats& s);
+
+//ռդ:طUVص㸲(عդ),
+//ÿֻһ:ڵ,,ͬʱȡ.
+//¼ĵ淨,֮صļ԰Ⲣ,дͻ
+class TexelMap {
+public:
+	struct Texel {
+		vec3 p, n;
+		int face = -1;  //ε(add˳),-1ʾûθ
+	};
+
+	TexelMap(int width, int height);
+
+	//ģ͵γtransform,ȫbuild
+	void add(const Model& model, const mat<4, 4>& transform);
+	//TILE x TILEĿ,֮䲢
+	void build(ThreadPool& pool = ThreadPool::global());
+
+	int width() const { return w; }
+	int height() const { return h; }
+	const Texel& operator[](int k) const { return texels[k]; }
+	const TexelMapStats& stats() const { return st; }
+
+	static constexpr int TILE = 32;
+
+private:
+	struct Triangle {
+		vec3 v[3], n;
+		vec2 t[3];  //,uvͼߴ
+	};
+	struct Edges;
+
+	int w, h;
+	std::vector<Triangle> tris;
+	std::vector<Texel> texels;
+	TexelMapStats st;
+};
+
+#endif // !TEXEL_MAP_H
@@ -0,0 +1,121 @@
+#include "texture.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+
+//TGAColorչBGRA8,ҶͼƵͨ,ûalphaĲ͸
+static uint32_t pack_bgra(const TGAColor& c) {
+	uint8_t b = c.bgra[0], g = c.bgra[1], r = c.bgra[2], a = c.bgra[3];
+	if (c.bytespp == 1) g = r = b;
+	if (c.bytespp < 4) a = 255;
+	return b | g << 8 | r << 16 | (uint32_t)a << 24;
+}
+
+static TGAColor unpack_acc(const float acc[4]) {
+	TGAColor c;
+	c.bytespp = 4;
+#ifdef USE_X86_SIMD
+	__m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(acc), _mm_set1_ps(.5f)));
+	v = _mm_packs_epi32(v, v);
+	v = _mm_packus_epi16(v, v);
+	const uint32_t bgra = (uint32_t)_mm_cvtsi128_si32(v);
+	for (int i = 0; i < 4; i++) c.bgra[i] = (uint8_t)(bgra >> (8 * i));
+#else
+	for (int i = 0; i < 4; i++) c.bgra[i] = (uint8_t)std::min(255, std::max(0, (int)(acc[i] + .5f)));
+#endif
+	return c;
+}
+
+MipTexture::MipTexture(std::shared_ptr<const TGAImage> image) : source(std::move(image)) {
+	const TGAImage& img = *source;
+	if (img.width() <= 0 || img.height() <= 0) return;
+	//ߴ,߲һİ
+	size_t total = 0;
+	for (int w = img.width(), h = img.height();; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+		const int tiles_x = (w + TILE - 1) / TILE, tiles_y = (h + TILE - 1) / TILE;
+		lv.push_back({ w, h, tiles_x, total });
+		total += (size_t)tiles_x * tiles_y * TILE * TILE;
+		if (w == 1 && h == 1) break;
+	}
+	texels.assign(total, 0);
+	for (int y = 0; y < lv[0].h; y++)
+		for (int x = 0; x < lv[0].w; x++)
+			texels[index(lv[0], x, y)] = pack_bgra(img.get(x, y));
+	//2x2ʽ˲,ߵһ()ظʹ
+	for (size_t k = 1; k < lv.size(); k++) {
+		const Level& src = lv[k - 1], & dst = lv[k];
+		for (int y = 0; y < dst.h; y++) {
+			const int y0 = std::min(2 * y, src.h - 1), y1 = std::min(2 * y + 1, src.h - 1);
+			for (int x = 0; x < dst.w; x++) {
+				const int x0 = std::min(2 * x, src.w - 1), x1 = std::min(2 * x + 1, src.w - 1);
+				const uint32_t t[4] = { texels[index(src, x0, y0)], texels[index(src, x1, y0)], texels[index(src, x0, y1)], texels[index(src, x1, y1)] };
+				uint32_t out = 0;
+				for (int c = 0; c < 32; c += 8) {
+					uint32_t sum = 2;
+					for (uint32_t v : t) sum += v >> c & 0xff;
+					out |= (sum >> 2) << c;
+				}
+				texels[index(dst, x, y)] = out;
+			}
+		}
+	}
+}
+
+void MipTexture::accumulate(int level, vec2 uv, float weight, float acc[4]) const {
+	const Level& l = lv[level];
+	float x = uv.x * l.w - .5f, y = uv.y * l.h - .5f;
+	//еԵ,NaNҲ䵽0
+	x = x > 0 ? x : 0, y = y > 0 ? y : 0;
+	x = x < l.w - 1 ? x : l.w - 1, y = y < l.h - 1 ? y : l.h - 1;
+	const int x0 = (int)x, y0 = (int)y, x1 = std::min(x0 + 1, l.w - 1), y1 = std::min(y0 + 1, l.h - 1);
+	const float fx = x - x0, fy = y - y0;
+	const float w[4] = { (1 - fx) * (1 - fy) * weight, fx * (1 - fy) * weight, (1 - fx) * fy * weight, fx * fy * weight };
+	const uint32_t t[4] = { texels[index(l, x0, y0)], texels[index(l, x1, y0)], texels[index(l, x0, y1)], texels[index(l, x1, y1)] };
+#ifdef USE_X86_SIMD
+	const __m128i zero = _mm_setzero_si128();
+	__m128 sum = _mm_loadu_ps(acc);
+	for (int i = 0; i < 4; i++) {
+		__m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)t[i]), zero), zero);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(w[i])));
+	}
+	_mm_storeu_ps(acc, sum);
+#else
+	for (int i = 0; i < 4; i++)
+		for (int c = 0; c < 4; c++) acc[c] += (float)(t[i] >> (8 * c) & 0xff) * w[i];
+#endif
+}
+
+TGAColor MipTexture::bilinear(vec2 uv, int level) const {
+	if (lv.empty()) return {};
+	float acc[4] = {};
+	accumulate(level, uv, 1.f, acc);
+	return unpack_acc(acc);
+}
+
+TGAColor MipTexture::trilinear(vec2 uv, float lod) const {
+	if (lv.empty()) return {};
+	if (lod <= 0) return bilinear(uv, 0);
+	const int level = (int)lod;
+	if (level >= levels() - 1) return bilinear(uv, levels() - 1);
+	const float f = lod - level;
+	float acc[4] = {};
+	accumulate(level, uv, 1.f - f, acc);
+	accumulate(level + 1, uv, f, acc);
+	return unpack_acc(acc);
+}
+
+float MipTexture::lod(vec2 duv_dx, vec2 duv_dy) const {
+	if (lv.empty()) return 0.f;
+	const float w = (float)lv[0].w, h = (float)lv[0].h;
+	const float dx = duv_dx.x * w * duv_dx.x * w + duv_dx.y * h * duv_dx.y * h;
+	const float dy = duv_dy.x * w * duv_dy.x * w + duv_dy.y * h * duv_dy.y * h;
+	const float rho2 = std::max(dx, dy);
+	//Ŵ(ΪNaN)ʱõ0
+	if (!(rho2 > 1.f)) return 0.f;
+	return std::min(.5f * std::log2(rho2), (float)(levels() - 1));
+}
+
+Texture::Texture(std::shared_ptr<const TGAImage> image) {
+	if (image) tex = std::make_shared<const MipTexture>(std::move(image));
+}
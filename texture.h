@@ -0,0 +1,85 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "tgaimage.h"
+
+//:ԭͼmip.mipÿչBGRA8,4x4ֿ,һ64ֽһ,
+//˫Ե2x2ͬһ.uv[0,1]ʱеԵ,(i+0.5)/w
+class MipTexture {
+public:
+	static constexpr int TILE = 4;
+
+	//ԭͼ2x2ʽ˲1x1
+	explicit MipTexture(std::shared_ptr<const TGAImage> img);
+
+	const TGAImage& image() const { return *source; }
+	int levels() const { return (int)lv.size(); }
+	int width(int level = 0) const { return lv[level].w; }
+	int height(int level = 0) const { return lv[level].h; }
+	//ԭͼmipռõڴ
+	size_t bytes() const {
+		return (size_t)source->width() * source->height() * source->bytespp() + texels.size() * sizeof(uint32_t);
+	}
+
+	TGAColor bilinear(vec2 uv, int level = 0) const;
+	//floor(lod)floor(lod)+1Բֵ,lod<=0ʱڵ0˫
+	TGAColor trilinear(vec2 uv, float lod) const;
+	//uvĻx,yĵlod:ؿռнϳһߵlog2
+	float lod(vec2 duv_dx, vec2 duv_dy) const;
+
+private:
+	struct Level {
+		int w, h, tiles_x;
+		size_t offset;  //texelsе
+	};
+
+	static size_t index(const Level& l, int x, int y) {
+		const size_t tile = (size_t)(y / TILE) * l.tiles_x + x / TILE;
+		return l.offset + tile * TILE * TILE + (y % TILE) * TILE + x % TILE;
+	}
+	//leveluv˫Խweightۼӵacc(b,g,r,a)
+	void accumulate(int level, vec2 uv, float weight, float acc[4]) const;
+
+	std::shared_ptr<const TGAImage> source;
+	std::vector<Level> lv;
+	std::vector<uint32_t> texels;
+};
+
+//:ֻ,ָֻ,
+//վõɫ,Ϊ0
+class Texture {
+public:
+	Texture() = default;
+	//mip
+	Texture(std::shared_ptr<const TGAImage> image);
+	Texture(std::shared_ptr<const MipTexture> tex) : tex(std::move(tex)) {}
+
+	const TGAImage& image() const { return tex ? tex->image() : empty(); }
+	int width() const { return tex ? tex->width() : 0; }
+	int height() const { return tex ? tex->height() : 0; }
+	//,ֱȡԭͼ
+	TGAColor get(int x, int y) const { return tex ? tex->image().get(x, y) : TGAColor(); }
+	TGAColor bilinear(vec2 uv) const { return tex ? tex->bilinear(uv) : TGAColor(); }
+	TGAColor trilinear(vec2 uv, vec2 duv_dx, vec2 duv_dy) const {
+		return tex ? tex->trilinear(uv, tex->lod(duv_dx, duv_dy)) : TGAColor();
+	}
+	size_t bytes() const { return tex ? tex->bytes() : 0; }
+	const std::shared_ptr<const MipTexture>& shared() const { return tex; }
+	explicit operator bool() const { return tex != nullptr; }
+
+private:
+	static const TGAImage& empty() {
+		static const TGAImage image;
+		return image;
+	}
+
+	std::shared_ptr<const MipTexture> tex;
+};
+
+#endif // !TEXTURE_H
@@ -1,49 +1,56 @@
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 #include "tgaimage.h"
+#include "mapped_file.h"
+#include "simd.h"
 
 TGAImage::TGAImage(const int w, const int h, const int bpp) : w(w), h(h), bpp(bpp), data(w*h*bpp, 0) {}
 
 bool TGAImage::read_tga_file(const std::string filename) {
-    std::ifstream in;
-    in.open (filename, std::ios::binary);
-    if (!in.is_open()) {
+    // one mapping instead of an I/O call per pixel or RLE packet
+    MappedFile file(filename);
+    if (!file.is_open()) {
         std::cerr << "can't open file " << filename << "\n";
-        in.close();
         return false;
     }
+    const std::uint8_t *in  = reinterpret_cast<const std::uint8_t *>(file.data());
+    const std::uint8_t *end = in + file.size();
     TGAHeader header;
-    in.read(reinterpret_cast<char *>(&header), sizeof(header));
-    if (!in.good()) {
-        in.close();
+    if (file.size()<sizeof(header)) {
         std::cerr << "an error occured while reading the header\n";
         return false;
     }
+    memcpy(&header, in, sizeof(header));
+    in += sizeof(header);
+    // skip the image id and the color map, neither is used
+    const size_t skip = header.idlength + (header.colormaptype ? header.colormaplength*((header.colormapdepth+7)>>3) : 0);
+    if (size_t(end-in)<skip) {
+        std::cerr << "an error occured while reading the header\n";
+        return false;
+    }
+    in += skip;
     w   = header.width;
     h   = header.height;
     bpp = header.bitsperpixel>>3;
     if (w<=0 || h<=0 || (bpp!=GRAYSCALE && bpp!=RGB && bpp!=RGBA)) {
-        in.close();
         std::cerr << "bad bpp (or width/height) value\n";
         return false;
     }
     size_t nbytes = bpp*w*h;
     data = std::vector<std::uint8_t>(nbytes, 0);
     if (3==header.datatypecode || 2==header.datatypecode) {
-        in.read(reinterpret_cast<char *>(data.data()), nbytes);
-        if (!in.good()) {
-            in.close();
+        if (size_t(end-in)<nbytes) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        memcpy(data.data(), in, nbytes);
     } else if (10==header.datatypecode||11==header.datatypecode) {
-        if (!load_rle_data(in)) {
-            in.close();
+        if (!load_rle_data(in, end)) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
     } else {
-        in.close();
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
@@ -52,63 +59,50 @@ bool TGAImage::read_tga_file(const std::string filename) {
     if (header.imagedescriptor & 0x10)
         flip_horizontally();
     std::cerr << w << "x" << h << "/" << bpp*8 << "\n";
-    in.close();
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-    size_t pixelcount = w*h;
+bool TGAImage::load_rle_data(const std::uint8_t *in, const std::uint8_t *end) {
+    const size_t pixelcount = w*h;
     size_t currentpixel = 0;
-    size_t currentbyte  = 0;
-    TGAColor colorbuffer;
-    do {
-        std::uint8_t chunkheader = 0;
-        chunkheader = in.get();
-        if (!in.good()) {
+    std::uint8_t *out = data.data();
+    while (currentpixel<pixelcount) {
+        if (in>=end) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        const std::uint8_t chunkheader = *in++;
+        const size_t count = (chunkheader & 0x7f) + 1;
+        if (currentpixel+count>pixelcount) {
+            std::cerr << "Too many pixels read\n";
+            return false;
+        }
+        const size_t nbytes = count*bpp;
+        const size_t packet = chunkheader<128 ? nbytes : bpp;
+        if (size_t(end-in)<packet) {
+            std::cerr << "an error occured while reading the header\n";
+            return false;
+        }
         if (chunkheader<128) {
-            chunkheader++;
-            for (int i=0; i<chunkheader; i++) {
-                in.read(reinterpret_cast<char *>(colorbuffer.bgra), bpp);
-                if (!in.good()) {
-                    std::cerr << "an error occured while reading the header\n";
-                    return false;
-                }
-                for (int t=0; t<bpp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
-            }
+            memcpy(out, in, nbytes);
+        } else if (bpp==1) {
+            memset(out, *in, count);
         } else {
-            chunkheader -= 127;
-            in.read(reinterpret_cast<char *>(colorbuffer.bgra), bpp);
-            if (!in.good()) {
-                std::cerr << "an error occured while reading the header\n";
-                return false;
-            }
-            for (int i=0; i<chunkheader; i++) {
-                for (int t=0; t<bpp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
-            }
+            // replicate the pixel by doubling the filled prefix
+            memcpy(out, in, bpp);
+            for (size_t filled=bpp; filled<nbytes; filled*=2)
+                memcpy(out+filled, out, std::min(filled, nbytes-filled));
         }
-    } while (currentpixel < pixelcount);
+        in += packet;
+        out += nbytes;
+        currentpixel += count;
+    }
     return true;
 }
 
 bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
-    constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
-    constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
-    constexpr std::uint8_t footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+    std::vector<std::uint8_t> buffer;
+    encode(buffer, vflip, rle);
     std::ofstream out;
     out.open (filename, std::ios::binary);
     if (!out.is_open()) {
@@ -116,43 +110,7 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
         out.close();
         return false;
     }
-    TGAHeader header;
-    header.bitsperpixel = bpp<<3;
-    header.width  = w;
-    header.height = h;
-    header.datatypecode = (bpp==GRAYSCALE?(rle?11:3):(rle?10:2));
-    header.imagedescriptor = vflip ? 0x00 : 0x20; // top-left or bottom-left origin
-    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
-    if (!out.good()) {
-        out.close();
-        std::cerr << "can't dump the tga file\n";
-        return false;
-    }
-    if (!rle) {
-        out.write(reinterpret_cast<const char *>(data.data()), w*h*bpp);
-        if (!out.good()) {
-            std::cerr << "can't unload raw data\n";
-            out.close();
-            return false;
-        }
-    } else if (!unload_rle_data(out)) {
-            out.close();
-            std::cerr << "can't unload rle data\n";
-            return false;
-        }
-    out.write(reinterpret_cast<const char *>(developer_area_ref), sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.write(reinterpret_cast<const char *>(extension_area_ref), sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.write(reinterpret_cast<const char *>(footer), sizeof(footer));
+    out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
         out.close();
@@ -162,44 +120,71 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
     return true;
 }
 
+void TGAImage::encode(std::vector<std::uint8_t> &out, const bool vflip, const bool rle) const {
+    constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
+    constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
+    constexpr std::uint8_t footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
+    TGAHeader header;
+    header.bitsperpixel = bpp<<3;
+    header.width  = w;
+    header.height = h;
+    header.datatypecode = (bpp==GRAYSCALE?(rle?11:3):(rle?10:2));
+    header.imagedescriptor = vflip ? 0x00 : 0x20; // top-left or bottom-left origin
+    const size_t nbytes = w*h*bpp;
+    out.clear();
+    // RLE output rarely exceeds the raw size; the vector still grows if it does
+    out.reserve(sizeof(header) + nbytes + sizeof(developer_area_ref) + sizeof(extension_area_ref) + sizeof(footer));
+    const std::uint8_t *p = reinterpret_cast<const std::uint8_t *>(&header);
+    out.insert(out.end(), p, p+sizeof(header));
+    if (!rle)
+        out.insert(out.end(), data.begin(), data.end());
+    else
+        unload_rle_data(out);
+    out.insert(out.end(), developer_area_ref, developer_area_ref+sizeof(developer_area_ref));
+    out.insert(out.end(), extension_area_ref, extension_area_ref+sizeof(extension_area_ref));
+    out.insert(out.end(), footer, footer+sizeof(footer));
+}
+
+// number of leading bytes where a[i]==b[i], up to n
+static size_t equal_prefix(const std::uint8_t *a, const std::uint8_t *b, const size_t n) {
+    size_t i = 0;
+#ifdef USE_X86_SIMD
+    for (; i+16<=n; i+=16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a+i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b+i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))!=0xffff) break;
+    }
+#endif
+    while (i<n && a[i]==b[i]) i++;
+    return i;
+}
+
+// Same packets as the per-pixel encoder this replaces: a run packet covers pixels equal to their predecessor,
+// a raw packet stops right before the first pair of equal pixels.
 // TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) const {
-    const std::uint8_t max_chunk_length = 128;
-    size_t npixels = w*h;
+void TGAImage::unload_rle_data(std::vector<std::uint8_t> &out) const {
+    const size_t max_chunk_length = 128;
+    const size_t npixels = w*h;
+    const std::uint8_t *pix = data.data();
+    auto same = [&](size_t a, size_t b) { return !memcmp(pix+a*bpp, pix+b*bpp, bpp); };
     size_t curpix = 0;
     while (curpix<npixels) {
-        size_t chunkstart = curpix*bpp;
-        size_t curbyte = curpix*bpp;
-        std::uint8_t run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bpp; t++)
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bpp]);
-            curbyte += bpp;
-            if (1==run_length)
-                raw = !succ_eq;
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq)
-                break;
-            run_length++;
-        }
-        curpix += run_length;
-        out.put(raw?run_length-1:run_length+127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
-        }
-        out.write(reinterpret_cast<const char *>(data.data()+chunkstart), (raw?run_length*bpp:bpp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        const size_t limit = std::min(max_chunk_length, npixels-curpix);
+        if (limit>1 && same(curpix, curpix+1)) {
+            // a pixel continues the run while all its bytes equal those one pixel back
+            const size_t run_length = 1 + equal_prefix(pix+curpix*bpp, pix+(curpix+1)*bpp, (limit-1)*bpp)/bpp;
+            out.push_back(run_length+127);
+            out.insert(out.end(), pix+curpix*bpp, pix+(curpix+1)*bpp);
+            curpix += run_length;
+        } else {
+            size_t run_length = 1;
+            while (run_length<limit && !same(curpix+run_length-1, curpix+run_length)) run_length++;
+            if (run_length<limit) run_length--; // the equal pair starts the next run
+            out.push_back(run_length-1);
+            out.insert(out.end(), pix+curpix*bpp, pix+(curpix+run_length)*bpp);
+            curpix += run_length;
         }
     }
-    return true;
 }
 
 TGAColor TGAImage::get(const int x, const int y) const {
@@ -222,11 +207,9 @@ void TGAImage::flip_horizontally() {
 }
 
 void TGAImage::flip_vertically() {
-    int half = h>>1;
-    for (int i=0; i<w; i++)
-        for (int j=0; j<half; j++)
-            for (int b=0; b<bpp; b++)
-                std::swap(data[(i+j*w)*bpp+b], data[(i+(h-1-j)*w)*bpp+b]);
+    const size_t bytes_per_line = size_t(w)*bpp;
+    for (int j=0; j<h/2; j++)
+        std::swap_ranges(data.begin()+j*bytes_per_line, data.begin()+(j+1)*bytes_per_line, data.begin()+(h-1-j)*bytes_per_line);
 }
 
 int TGAImage::width() const {
@@ -237,6 +220,10 @@ int TGAImage::height() const {
     return h;
 }
 
+int TGAImage::bytespp() const {
+    return bpp;
+}
+
 void TGAImage::clear() {
     std::fill(data.begin(), data.end(), 0);
 }
@@ -39,16 +39,21 @@ struct TGAImage {
     TGAImage(const int w, const int h, const int bpp);
     bool  read_tga_file(const std::string filename);
     bool write_tga_file(const std::string filename, const bool vflip=true, const bool rle=true) const;
+    // the complete file contents, so a frame can be written out while the next one renders
+    void encode(std::vector<std::uint8_t> &out, const bool vflip=true, const bool rle=true) const;
     void flip_horizontally();
     void flip_vertically();
     TGAColor get(const int x, const int y) const;
     void set(const int x, const int y, const TGAColor &c);
     int width()  const;
     int height() const;
+    int bytespp() const;
+    // raw pixels, row y starts at buffer()+y*width()*bytespp()
+    const std::uint8_t *buffer() const { return data.data(); }
     void clear();
 private:
-    bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out) const;
+    bool   load_rle_data(const std::uint8_t *in, const std::uint8_t *end);
+    void unload_rle_data(std::vector<std::uint8_t> &out) const;
 
     int w   = 0;
     int h   = 0;
@@ -0,0 +1,102 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+
+//ǰ߳ԼĶ±,߳worker_loop,̶߳0
+static thread_local unsigned self_queue = 0;
+
+ThreadPool::ThreadPool(unsigned nthreads) : queues(nthreads ? nthreads : 1) {
+	for (unsigned i = 1; i < queues.size(); i++)
+		workers.emplace_back([this, i] { worker_loop(i); });
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(wake_mtx);
+		stop = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers) t.join();
+}
+
+ThreadPool& ThreadPool::global() {
+	static ThreadPool pool;
+	return pool;
+}
+
+bool ThreadPool::pop(unsigned self, std::function<void()>& task) {
+	//ȡԼĶβ
+	{
+		Queue& q = queues[self];
+		std::lock_guard<std::mutex> lock(q.mtx);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	//͵˵Ķͷ
+	for (unsigned k = 1; k < queues.size(); k++) {
+		Queue& q = queues[(self + k) % queues.size()];
+		std::lock_guard<std::mutex> lock(q.mtx);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::worker_loop(unsigned self) {
+	self_queue = self;
+	std::function<void()> task;
+	for (;;) {
+		if (pop(self, task)) {
+			task();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(wake_mtx);
+		wake.wait(lock, [this] { return stop || queued > 0; });
+		if (stop) return;
+	}
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int)>& fn) {
+	if (n <= 0) return;
+	//һεõ:±next,쵽nԺֱ˳.
+	//shared_ptr,÷غֵİ첻±,ҲѾʧЧfn
+	struct Group {
+		const std::function<void(int)>* fn;
+		int n;
+		std::atomic<int> next{ 0 }, done{ 0 };
+	};
+	auto group = std::make_shared<Group>();
+	group->fn = &fn;
+	group->n = n;
+	auto run = [](Group& g) {
+		for (int i; (i = g.next++) < g.n; g.done++) (*g.fn)(i);
+	};
+
+	//Ž̵߳Ķ,ԼǷɵֱ߳
+	const unsigned self = self_queue;
+	const int helpers = std::min<int>(n, (int)queues.size()) - 1;
+	for (int k = 1; k <= helpers; k++) {
+		Queue& q = queues[(self + k) % queues.size()];
+		std::lock_guard<std::mutex> lock(q.mtx);
+		q.tasks.emplace_back([group, run] { run(*group); });
+	}
+	if (helpers > 0) {
+		queued += helpers;
+		{
+			std::lock_guard<std::mutex> lock(wake_mtx);
+		}
+		wake.notify_all();
+	}
+	run(*group);
+	//ʣµ±ѱ߳,
+	while (group->done < n) std::this_thread::yield();
+}
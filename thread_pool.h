@@ -0,0 +1,44 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//ȡ̳߳:ÿ߳һ˫˶,ԼӶβȡ,ʱӱ˶ͷ͵
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned nthreads = std::thread::hardware_concurrency());
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//ִfn(0..n-1),߳Ҳ,ȫɺ󷵻.
+	//Ƕ:ÿεһ,ȴִֻ߳б±,ȥܱ
+	void parallel_for(int n, const std::function<void(int)>& fn);
+	unsigned size() const { return (unsigned)workers.size() + 1; }
+
+	static ThreadPool& global();
+
+private:
+	struct Queue {
+		std::mutex mtx;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	bool pop(unsigned self, std::function<void()>& task);
+	void worker_loop(unsigned self);
+
+	std::vector<std::thread> workers;
+	std::vector<Queue> queues;           //queues[0]ڲڳĵ߳
+	std::mutex wake_mtx;
+	std::condition_variable wake;
+	std::atomic<int> queued{ 0 };
+	bool stop = false;
+};
+
+#endif // !THREAD_POOL_H
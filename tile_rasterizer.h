@@ -0,0 +1,95 @@
+#ifndef TILE_RASTERIZER_H
+#define TILE_RASTERIZER_H
+
+#include "our_gl.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <optional>
+#include <vector>
+
+//ֿդ:triangle()ֻΰΧз̶ֵСĻ,flush()ʱɫ
+//ڰύ˳,ÿֻһ,˽봮draw()λһ
+//ɫ״̬bind()ʱһ,ֻShaderT::Varyingsɫ±;
+//flush()ʱÿԼɫ,ʱֻдvaryings
+//flush()ʱzbufferϽHierarchicalZ,ȫסκ8x8鲻դɫ
+template <typename ShaderT>
+class TileRasterizer {
+public:
+	TileRasterizer(int width, int height, int tile_size = 32, ThreadPool& pool = ThreadPool::global())
+		: width(width), height(height), tile_size(tile_size),
+		  tiles_x((width + tile_size - 1) / tile_size), tiles_y((height + tile_size - 1) / tile_size),
+		  pool(pool), bins(tiles_x * tiles_y) {
+		//ı߽ҪHierarchicalZ8x8,ÿ½ֻһ̸߳
+		assert(tile_size % HierarchicalZ::BLOCK == 0);
+	}
+
+	//uniform,ʵ´bind֮ǰ״̬;Щ֮Ҫbind
+	void bind(const ShaderT& shader) {
+		shaders.push_back(shader);
+	}
+
+	//ͼԪװﴮ,üÿθԷֿ.shaderֻȡcull_facevaryings
+	void triangle(const std::array<vec4, 3>& v, const ShaderT& shader) {
+		assert(!shaders.empty());
+		Primitive prims[MAX_PRIMITIVES];
+		const int n = assemble(v, shader.cull_face, width, height, prims, &cull_stats);
+		for (int i = 0; i < n; i++) bin(prims[i], shader.varyings());
+	}
+
+	void flush(float* zbuffer, TGAImage& image) {
+		HierarchicalZ hiz(zbuffer, width, height);
+		std::vector<CullStats> tile_stats(bins.size());
+		pool.parallel_for(tiles_x * tiles_y, [&](int tile) {
+			int x0 = (tile % tiles_x) * tile_size, y0 = (tile / tiles_x) * tile_size;
+			int x1 = std::min(x0 + tile_size, width) - 1, y1 = std::min(y0 + tile_size, height) - 1;
+			std::optional<ShaderT> shader;
+			int bound = -1;
+			for (int idx : bins[tile]) {
+				const Triangle& t = tris[idx];
+				if (t.shader != bound) shader.emplace(shaders[t.shader]), bound = t.shader;
+				shader->set_varyings(t.varyings);
+				::rasterize(t.prim.v, *shader, hiz.data(), &hiz, &tile_stats[tile], image, x0, y0, x1, y1, t.prim.clipped ? &t.prim.bary : nullptr);
+			}
+		});
+		for (const CullStats& s : tile_stats) cull_stats += s;
+		tris.clear();
+		for (std::vector<int>& bin : bins) bin.clear();
+		//bindɫflush֮Ч
+		shaders.erase(shaders.begin(), shaders.end() - 1);
+	}
+
+	//triangle()ͼԪװflush()޳.ͬһο缸ʱֲ޳ÿһ
+	const CullStats& stats() const { return cull_stats; }
+
+private:
+	struct Triangle {
+		Primitive prim;
+		typename ShaderT::Varyings varyings;
+		int shader;  //shaders±
+	};
+
+	void bin(const Primitive& prim, const typename ShaderT::Varyings& varyings) {
+		auto [left, right, bottom, top] = boundingBox(prim.v);
+		left = std::max(left, 0.f), bottom = std::max(bottom, 0.f);
+		right = std::min(right, (float)width - 1), top = std::min(top, (float)height - 1);
+		if (left > right || bottom > top) return;
+
+		int idx = (int)tris.size();
+		tris.push_back({ prim, varyings, (int)shaders.size() - 1 });
+		for (int ty = int(bottom) / tile_size; ty <= int(top) / tile_size; ty++)
+			for (int tx = int(left) / tile_size; tx <= int(right) / tile_size; tx++)
+				bins[tx + ty * tiles_x].push_back(idx);
+	}
+
+	int width, height, tile_size, tiles_x, tiles_y;
+	ThreadPool& pool;
+	std::vector<ShaderT> shaders;
+	std::deque<Triangle> tris;
+	std::vector<std::vector<int>> bins;
+	CullStats cull_stats;
+};
+
+#endif // !TILE_RASTERIZER_H